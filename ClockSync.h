@@ -0,0 +1,218 @@
+/**
+ * @file ClockSync.h
+ * @author Ori Garibi
+ * @brief robust per-grabber fit of grabber clock against host clock, plus timing statistics for a trial
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+//mean, standard deviation and range of a series (Welford)
+class RunningStats{
+    public:
+        RunningStats();
+        void add(double x);
+        unsigned int getCount();
+        double getMean();
+        double getStdDev();
+        double getMin();
+        double getMax();
+    private:
+        unsigned int count;
+        double mean;
+        double m2;
+        double lo;
+        double hi;
+};
+RunningStats::RunningStats(){
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    lo = 0;
+    hi = 0;
+}
+void RunningStats::add(double x){
+    if(count == 0 || x < lo){
+        lo = x;
+    }
+    if(count == 0 || x > hi){
+        hi = x;
+    }
+    ++count;
+    double delta = x - mean;
+    mean += delta/count;
+    m2 += delta*(x - mean);
+}
+unsigned int RunningStats::getCount(){
+    return count;
+}
+double RunningStats::getMean(){
+    return mean;
+}
+double RunningStats::getStdDev(){
+    return count > 1 ? std::sqrt(m2/(count - 1)) : 0;
+}
+double RunningStats::getMin(){
+    return lo;
+}
+double RunningStats::getMax(){
+    return hi;
+}
+
+//host = hostBase + offset + drift*(grabber - grabberBase), refitted on a sliding window of (grabber, host) pairs
+class ClockFit{
+    public:
+        ClockFit(unsigned int window = 256, unsigned int refitEvery = 64);
+        void add(uint64_t grabberTs, uint64_t hostTs);
+        uint64_t toHost(uint64_t grabberTs);
+        double getDrift();
+        double getError();
+    private:
+        void refit();
+        unsigned int window;
+        unsigned int refitEvery;
+        unsigned int sinceFit;
+        std::vector<double> g; //relative to the first sample, ring of window entries
+        std::vector<double> h;
+        size_t next;
+        bool started;
+        uint64_t grabberBase;
+        uint64_t hostBase;
+        double offset;
+        double drift;
+        double error;
+};
+/**
+ * @brief Construct a new ClockFit:: ClockFit object
+ *
+ * @param window1 number of recent samples the fit uses
+ * @param refitEvery1 samples between two fits, keeps the cost off the per-frame path
+ */
+ClockFit::ClockFit(unsigned int window1, unsigned int refitEvery1){
+    if(window1 < 4){
+        throw std::runtime_error("clock fit window is too small");
+    }
+    window = window1;
+    refitEvery = refitEvery1;
+    sinceFit = 0;
+    next = 0;
+    started = false;
+    grabberBase = 0;
+    hostBase = 0;
+    offset = 0;
+    drift = 1;
+    error = 0;
+}
+/**
+ * @brief add one observation
+ *
+ * @param grabberTs buffer timestamp from the grabber (microseconds)
+ * @param hostTs Tools::getTimestamp() when the buffer was delivered (microseconds)
+ */
+void ClockFit::add(uint64_t grabberTs, uint64_t hostTs){
+    if(!started){
+        started = true;
+        grabberBase = grabberTs;
+        hostBase = hostTs;
+    }
+    double x = (double)(int64_t)(grabberTs - grabberBase);
+    double y = (double)(int64_t)(hostTs - hostBase);
+    if(g.size() < window){
+        g.push_back(x);
+        h.push_back(y);
+    }
+    else{
+        g[next] = x;
+        h[next] = y;
+    }
+    next = (next + 1) % window;
+    if(++sinceFit >= refitEvery || g.size() == 4){ //first fit as soon as there is enough data
+        refit();
+        sinceFit = 0;
+    }
+}
+/**
+ * @brief Theil-Sen slope on pairs half a window apart, intercept on the lower envelope
+ *
+ * Host samples are taken at delivery, so their error is one sided: the intercept is the 10th percentile of the
+ * residuals rather than the median, which tracks the least delayed deliveries.
+ */
+void ClockFit::refit(){
+    const size_t n = g.size();
+    const size_t half = n/2;
+    std::vector<double> v;
+    for (size_t i = 0; i + half < n; i++)
+    {
+        double dx = g[i + half] - g[i];
+        if(dx != 0){
+            v.push_back((h[i + half] - h[i])/dx);
+        }
+    }
+    if(v.empty()){
+        return;
+    }
+    std::nth_element(v.begin(), v.begin() + v.size()/2, v.end());
+    drift = v[v.size()/2];
+    v.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+        v.push_back(h[i] - drift*g[i]);
+    }
+    std::nth_element(v.begin(), v.begin() + v.size()/10, v.end());
+    offset = v[v.size()/10];
+    for (size_t i = 0; i < n; i++) //median absolute deviation around the fit
+    {
+        v[i] = std::fabs(h[i] - drift*g[i] - offset);
+    }
+    std::nth_element(v.begin(), v.begin() + v.size()/2, v.end());
+    error = v[v.size()/2];
+}
+uint64_t ClockFit::toHost(uint64_t grabberTs){
+    double x = (double)(int64_t)(grabberTs - grabberBase);
+    return hostBase + (int64_t)std::llround(offset + drift*x);
+}
+//host microseconds per grabber microsecond
+double ClockFit::getDrift(){
+    return drift;
+}
+//median deviation of the samples from the fit, microseconds
+double ClockFit::getError(){
+    return error;
+}
+
+//one ClockFit per grabber plus the skew and trigger latency statistics of a trial
+class ClockSync{
+    public:
+        ClockSync(int numGrabbers);
+        void add(int grabber, uint64_t grabberTs, uint64_t hostTs);
+        uint64_t toHost(int grabber, uint64_t grabberTs);
+        ClockFit &getFit(int grabber);
+        RunningStats skew;
+        int64_t triggerLatency; //first post-trigger frame minus trigger event, -1 when unknown
+    private:
+        std::vector<ClockFit> fits;
+};
+ClockSync::ClockSync(int numGrabbers){
+    fits.assign(numGrabbers, ClockFit());
+    triggerLatency = -1;
+}
+void ClockSync::add(int grabber, uint64_t grabberTs, uint64_t hostTs){
+    fits[grabber].add(grabberTs, hostTs);
+}
+uint64_t ClockSync::toHost(int grabber, uint64_t grabberTs){
+    return fits[grabber].toHost(grabberTs);
+}
+ClockFit &ClockSync::getFit(int grabber){
+    return fits[grabber];
+}
+#endif
@@ -0,0 +1,231 @@
+/**
+ * @file Crc32c.h
+ * @author Ori Garibi
+ * @brief CRC32C (Castagnoli) with the SSE4.2 or ARMv8 CRC instructions and a table fallback
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <iomanip>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32C_TARGET
+#else
+#define CRC32C_TARGET __attribute__((target("sse4.2"))) //no -msse4.2 needed, the CPU is checked at run time
+#endif
+#elif defined(__ARM_FEATURE_CRC32) //build with -march=armv8-a+crc
+#define CRC32C_ARM
+#include <arm_acle.h>
+#define CRC32C_TARGET
+#endif
+
+static const uint32_t CRC32C_POLY = 0x82f63b78; //reflected Castagnoli polynomial
+static const size_t CRC32C_LANE = 8192; //bytes per lane of the three way interleaved loop
+
+inline uint32_t gf2Times(const uint32_t *mat, uint32_t vec){
+    uint32_t sum = 0;
+    while(vec){
+        if(vec & 1){
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+inline void gf2Square(uint32_t *square, const uint32_t *mat){
+    for (int n = 0; n < 32; n++)
+    {
+        square[n] = gf2Times(mat, mat[n]);
+    }
+}
+/**
+ * @brief tables that advance a CRC register over len zero bytes, used to join the interleaved lanes
+ *
+ * @param zeros 4 tables of 256 entries, one per byte of the register
+ * @param len number of zero bytes, a power of two
+ */
+inline void crc32cZeros(uint32_t zeros[][256], size_t len){
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = CRC32C_POLY; //operator for one zero bit
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2Square(even, odd); //two zero bits
+    gf2Square(odd, even); //four zero bits, the next square is one zero byte
+    const uint32_t *op = odd;
+    do {
+        gf2Square(even, odd);
+        op = even;
+        len >>= 1;
+        if(len == 0){
+            break;
+        }
+        gf2Square(odd, even);
+        op = odd;
+        len >>= 1;
+    } while(len);
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        zeros[0][n] = gf2Times(op, n);
+        zeros[1][n] = gf2Times(op, n << 8);
+        zeros[2][n] = gf2Times(op, n << 16);
+        zeros[3][n] = gf2Times(op, n << 24);
+    }
+}
+inline uint32_t crc32cShift(const uint32_t zeros[][256], uint32_t crc){
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+//byte table of the fallback and zeros tables of the interleaved loop, built once
+struct Crc32cTables{
+    Crc32cTables(){
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            }
+            table[n] = c;
+        }
+        crc32cZeros(zeros, CRC32C_LANE);
+    }
+    uint32_t table[256];
+    uint32_t zeros[4][256];
+};
+inline const Crc32cTables &crc32cTables(){
+    static const Crc32cTables tables;
+    return tables;
+}
+
+//byte at a time, for CPUs without the instruction
+inline uint32_t crc32cTable(uint32_t crc, const uint8_t *data, size_t size){
+    const uint32_t *table = crc32cTables().table;
+    crc = ~crc;
+    while(size--){
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+#ifdef CRC32C_X86
+CRC32C_TARGET inline uint64_t crc32cStep(uint64_t crc, uint64_t v){
+    return _mm_crc32_u64(crc, v);
+}
+CRC32C_TARGET inline uint64_t crc32cByte(uint64_t crc, uint8_t v){
+    return _mm_crc32_u8((uint32_t)crc, v);
+}
+#else
+inline uint64_t crc32cStep(uint64_t crc, uint64_t v){
+    return __crc32cd((uint32_t)crc, v);
+}
+inline uint64_t crc32cByte(uint64_t crc, uint8_t v){
+    return __crc32cb((uint32_t)crc, v);
+}
+#endif
+/**
+ * @brief three independent lanes hide the 3 cycle latency of the instruction, the lanes are joined with the zeros tables
+ *
+ * @param crc previous CRC, 0 to start
+ * @param data bytes to add
+ * @param size number of bytes
+ * @return uint32_t CRC including data
+ */
+CRC32C_TARGET inline uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t size){
+    const uint32_t (*zeros)[256] = crc32cTables().zeros;
+    uint64_t crc0 = ~crc;
+    while(size && ((uintptr_t)data & 7)){
+        crc0 = crc32cByte(crc0, *data++);
+        --size;
+    }
+    while(size >= 3*CRC32C_LANE){
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t *end = data + CRC32C_LANE;
+        do {
+            uint64_t v0, v1, v2;
+            memcpy(&v0, data, 8);
+            memcpy(&v1, data + CRC32C_LANE, 8);
+            memcpy(&v2, data + 2*CRC32C_LANE, 8);
+            crc0 = crc32cStep(crc0, v0);
+            crc1 = crc32cStep(crc1, v1);
+            crc2 = crc32cStep(crc2, v2);
+            data += 8;
+        } while(data < end);
+        crc0 = crc32cShift(zeros, (uint32_t)crc0) ^ crc1;
+        crc0 = crc32cShift(zeros, (uint32_t)crc0) ^ crc2;
+        data += 2*CRC32C_LANE;
+        size -= 3*CRC32C_LANE;
+    }
+    while(size >= 8){
+        uint64_t v;
+        memcpy(&v, data, 8);
+        crc0 = crc32cStep(crc0, v);
+        data += 8;
+        size -= 8;
+    }
+    while(size){
+        crc0 = crc32cByte(crc0, *data++);
+        --size;
+    }
+    return ~(uint32_t)crc0;
+}
+#endif
+
+//true when crc32c() runs on the CRC instruction
+inline bool crc32cAccelerated(){
+#if defined(CRC32C_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#elif defined(CRC32C_X86)
+    return __builtin_cpu_supports("sse4.2");
+#elif defined(CRC32C_ARM)
+    return true;
+#else
+    return false;
+#endif
+}
+/**
+ * @brief CRC32C of a buffer, can be chained: crc32c(crc32c(0, a, na), b, nb) == crc32c of a followed by b
+ *
+ * @param crc previous CRC, 0 to start
+ * @param data bytes to add
+ * @param size number of bytes
+ * @return uint32_t CRC including data
+ */
+inline uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t size){
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+    static const bool hardware = crc32cAccelerated();
+    if(hardware){
+        return crc32cHardware(crc, data, size);
+    }
+#endif
+    return crc32cTable(crc, data, size);
+}
+//8 hex digits, the form used in the CSV files
+inline std::string crc32cHex(uint32_t crc){
+    std::stringstream ss;
+    ss << std::hex << std::setw(8) << std::setfill('0') << crc;
+    return ss.str();
+}
+#endif
@@ -0,0 +1,187 @@
+/**
+ * @file DeviceProfile.h
+ * @author Ori Garibi
+ * @brief desired grabber feature values, applied by writing only what differs from the current state
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef DEVICEPROFILE_H
+#define DEVICEPROFILE_H
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+#include <D:\Euresys\eGrabber\include\EGrabber.h>
+
+enum ProfileModule { PROFILE_INTERFACE, PROFILE_DEVICE, PROFILE_STREAM, PROFILE_REMOTE };
+enum ProfileType { PROFILE_STRING, PROFILE_INTEGER, PROFILE_FLOAT };
+
+//one feature write; selectors are always written because the features after them are read through them
+struct ProfileEntry{
+    ProfileModule module;
+    ProfileType type;
+    std::string feature;
+    std::string value;
+    bool selector;
+};
+
+class DeviceProfile{
+    public:
+        DeviceProfile();
+        ~DeviceProfile();
+        void addString(ProfileModule module, const std::string &feature, const std::string &value, bool selector = false);
+        void addInteger(ProfileModule module, const std::string &feature, int64_t value);
+        void addFloat(ProfileModule module, const std::string &feature, double value);
+        std::string serialize() const;
+        bool matchesFile(const std::string &path) const;
+        void save(const std::string &path) const;
+        template <class G> unsigned int apply(G &grabber, bool diff);
+    private:
+        template <class M, class G> std::string read(G &grabber, const ProfileEntry &e);
+        template <class M, class G> void write(G &grabber, const ProfileEntry &e);
+        template <class G> std::string readEntry(G &grabber, const ProfileEntry &e);
+        template <class G> void writeEntry(G &grabber, const ProfileEntry &e);
+        static bool same(const ProfileEntry &e, const std::string &current);
+        std::vector<ProfileEntry> entries;
+};
+DeviceProfile::DeviceProfile(){
+}
+DeviceProfile::~DeviceProfile(){
+}
+void DeviceProfile::addString(ProfileModule module, const std::string &feature, const std::string &value, bool selector){
+    ProfileEntry e;
+    e.module = module;
+    e.type = PROFILE_STRING;
+    e.feature = feature;
+    e.value = value;
+    e.selector = selector;
+    entries.push_back(e);
+}
+void DeviceProfile::addInteger(ProfileModule module, const std::string &feature, int64_t value){
+    ProfileEntry e;
+    e.module = module;
+    e.type = PROFILE_INTEGER;
+    e.feature = feature;
+    e.value = std::to_string(value);
+    e.selector = false;
+    entries.push_back(e);
+}
+void DeviceProfile::addFloat(ProfileModule module, const std::string &feature, double value){
+    std::stringstream ss;
+    ss << std::setprecision(17) << value;
+    ProfileEntry e;
+    e.module = module;
+    e.type = PROFILE_FLOAT;
+    e.feature = feature;
+    e.value = ss.str();
+    e.selector = false;
+    entries.push_back(e);
+}
+//one line per entry: module type selector feature=value
+std::string DeviceProfile::serialize() const{
+    std::stringstream ss;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        ss << entries[i].module << " " << entries[i].type << " " << entries[i].selector << " " << entries[i].feature << "=" << entries[i].value << "\n";
+    }
+    return ss.str();
+}
+/**
+ * @brief compare with the profile cached by the last successful configuration
+ *
+ * @param path cache file
+ * @return true when the device was last configured with exactly this profile
+ */
+bool DeviceProfile::matchesFile(const std::string &path) const{
+    std::ifstream in(path.c_str());
+    if(!in){
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str() == serialize();
+}
+void DeviceProfile::save(const std::string &path) const{
+    std::ofstream out(path.c_str());
+    out << serialize();
+}
+/**
+ * @brief write the profile to a grabber
+ *
+ * @param grabber grabber to configure
+ * @param diff read every feature first and only write those that differ
+ * @return unsigned int number of feature writes
+ */
+template <class G> unsigned int DeviceProfile::apply(G &grabber, bool diff){
+    unsigned int writes = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const ProfileEntry &e = entries[i];
+        if(diff && !e.selector && same(e, readEntry(grabber, e))){
+            continue;
+        }
+        writeEntry(grabber, e);
+        ++writes;
+    }
+    return writes;
+}
+template <class M, class G> std::string DeviceProfile::read(G &grabber, const ProfileEntry &e){
+    switch(e.type){
+        case PROFILE_STRING:
+            return grabber.template getString<M>(e.feature);
+        case PROFILE_INTEGER:
+            return std::to_string(grabber.template getInteger<M>(e.feature));
+        default: {
+            std::stringstream ss;
+            ss << std::setprecision(17) << grabber.template getFloat<M>(e.feature);
+            return ss.str();
+        }
+    }
+}
+template <class M, class G> void DeviceProfile::write(G &grabber, const ProfileEntry &e){
+    switch(e.type){
+        case PROFILE_STRING:
+            grabber.template setString<M>(e.feature, e.value);
+            break;
+        case PROFILE_INTEGER:
+            grabber.template setInteger<M>(e.feature, std::strtoll(e.value.c_str(), NULL, 10));
+            break;
+        default:
+            grabber.template setFloat<M>(e.feature, std::strtod(e.value.c_str(), NULL));
+            break;
+    }
+}
+template <class G> std::string DeviceProfile::readEntry(G &grabber, const ProfileEntry &e){
+    switch(e.module){
+        case PROFILE_INTERFACE: return read<Euresys::InterfaceModule>(grabber, e);
+        case PROFILE_DEVICE: return read<Euresys::DeviceModule>(grabber, e);
+        case PROFILE_STREAM: return read<Euresys::StreamModule>(grabber, e);
+        default: return read<Euresys::RemoteModule>(grabber, e);
+    }
+}
+template <class G> void DeviceProfile::writeEntry(G &grabber, const ProfileEntry &e){
+    switch(e.module){
+        case PROFILE_INTERFACE: write<Euresys::InterfaceModule>(grabber, e); break;
+        case PROFILE_DEVICE: write<Euresys::DeviceModule>(grabber, e); break;
+        case PROFILE_STREAM: write<Euresys::StreamModule>(grabber, e); break;
+        default: write<Euresys::RemoteModule>(grabber, e); break;
+    }
+}
+//floats are compared with a relative tolerance, the device may round what it was given
+bool DeviceProfile::same(const ProfileEntry &e, const std::string &current){
+    if(e.type != PROFILE_FLOAT){
+        return e.value == current;
+    }
+    double want = std::strtod(e.value.c_str(), NULL);
+    double have = std::strtod(current.c_str(), NULL);
+    return std::fabs(want - have) <= 1e-9*std::fmax(1.0, std::fabs(want));
+}
+#endif
@@ -0,0 +1,536 @@
+/**
+ * @file FileWriter.h
+ * @author Ori Garibi
+ * @brief asynchronous positional file writer with an io_uring backend and a portable thread pool fallback
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include "Trace.h"
+
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#define FILEWRITER_POSIX
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(WITH_LIBURING) //build with -DWITH_LIBURING -luring
+#include <liburing.h>
+#define FILEWRITER_URING
+#endif
+#else
+#include <windows.h>
+#include <malloc.h>
+#endif
+
+//direct I/O needs the buffer, the offset and the size aligned to the sector size
+static const size_t WRITER_ALIGN = 4096;
+
+inline size_t alignUp(size_t size){
+    return (size + WRITER_ALIGN - 1)/WRITER_ALIGN*WRITER_ALIGN;
+}
+#ifdef FILEWRITER_POSIX
+inline uint8_t *alignedAlloc(size_t size){
+    void *p = NULL;
+    if(posix_memalign(&p, WRITER_ALIGN, alignUp(size))){
+        throw std::runtime_error("alignedAlloc failed");
+    }
+    return (uint8_t *)p;
+}
+inline void alignedFree(uint8_t *p){
+    free(p);
+}
+#else
+inline uint8_t *alignedAlloc(size_t size){
+    void *p = _aligned_malloc(alignUp(size), WRITER_ALIGN);
+    if(p == NULL){
+        throw std::runtime_error("alignedAlloc failed");
+    }
+    return (uint8_t *)p;
+}
+inline void alignedFree(uint8_t *p){
+    _aligned_free(p);
+}
+#endif
+
+//called on a writer thread once the bytes are in the file, this is where the caller recycles its buffer
+typedef std::function<void()> WriteDone;
+
+//files are opened and closed synchronously, writes are queued and complete in any order
+class FileWriter{
+    public:
+        FileWriter();
+        virtual ~FileWriter();
+        int open(const std::string &path, uint64_t preallocate, bool direct, bool truncate = true);
+        void close(int file, uint64_t length);
+        virtual void write(int file, const uint8_t *buf, size_t size, uint64_t offset, WriteDone done) = 0;
+        virtual void kick();
+        virtual std::string getName() = 0;
+        void wait(int file);
+        bool isIdle(int file);
+        void drain();
+    protected:
+#ifdef FILEWRITER_POSIX
+        typedef int Native;
+#else
+        typedef HANDLE Native;
+#endif
+        struct Entry{
+            Native handle;
+            bool direct;
+            bool used;
+            unsigned int pending;
+            std::string path;
+        };
+        size_t started(int file, size_t size);
+        void completed(int file, const WriteDone &done, const std::string &failure);
+        Native native(int file);
+        std::string filePath(int file);
+        void writeFully(int file, const uint8_t *buf, size_t size, uint64_t offset);
+        std::mutex lock;
+        std::condition_variable cond;
+        std::vector<Entry> files;
+        unsigned int pending;
+        std::string error;
+};
+FileWriter::FileWriter(){
+    pending = 0;
+}
+FileWriter::~FileWriter(){
+}
+/**
+ * @brief create (truncate) a file for writing
+ *
+ * @param path file to create
+ * @param preallocate bytes to reserve up front so the file system does not grow the file write by write, 0 for none
+ * @param direct bypass the page cache, every write must then use an alignedAlloc buffer
+ * @param truncate drop the old content; false reuses the blocks of an existing file, which then needs no new allocation
+ * @return int file id for write(), wait() and close()
+ */
+int FileWriter::open(const std::string &path, uint64_t preallocate, bool direct, bool truncate){
+    Entry e;
+    e.direct = direct;
+    e.used = true;
+    e.pending = 0;
+    e.path = path;
+#ifdef FILEWRITER_POSIX
+    int flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0);
+#ifdef O_DIRECT
+    if(direct){
+        flags |= O_DIRECT;
+    }
+#endif
+    e.handle = ::open(path.c_str(), flags, 0644);
+    if(e.handle < 0){
+        throw std::runtime_error("could not open " + path);
+    }
+#ifdef __linux__
+    if(preallocate && posix_fallocate(e.handle, 0, alignUp(preallocate))){
+        ::close(e.handle);
+        throw std::runtime_error("could not preallocate " + path);
+    }
+#endif
+#else
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(direct){
+        flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+    }
+    e.handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, flags, NULL);
+    if(e.handle == INVALID_HANDLE_VALUE){
+        throw std::runtime_error("could not open " + path);
+    }
+    if(preallocate){
+        LARGE_INTEGER size;
+        size.QuadPart = alignUp(preallocate);
+        if(!SetFilePointerEx(e.handle, size, NULL, FILE_BEGIN) || !SetEndOfFile(e.handle)){
+            CloseHandle(e.handle);
+            throw std::runtime_error("could not preallocate " + path);
+        }
+    }
+#endif
+    std::unique_lock<std::mutex> guard(lock);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if(!files[i].used){
+            files[i] = e;
+            return (int)i;
+        }
+    }
+    files.push_back(e);
+    return (int)files.size() - 1;
+}
+/**
+ * @brief wait for the file's writes, cut it to its real length and close it
+ *
+ * @param file file id
+ * @param length bytes of payload, drops the preallocation and the direct I/O padding
+ */
+void FileWriter::close(int file, uint64_t length){
+    wait(file);
+    Native handle = native(file);
+    bool ok;
+#ifdef FILEWRITER_POSIX
+    ok = ftruncate(handle, length) == 0;
+    ok = (::close(handle) == 0) && ok;
+#else
+    LARGE_INTEGER size;
+    size.QuadPart = length;
+    ok = SetFilePointerEx(handle, size, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+    ok = CloseHandle(handle) && ok;
+#endif
+    std::string path;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        files[file].used = false;
+        path = files[file].path;
+    }
+    if(!ok){
+        throw std::runtime_error("could not close " + path);
+    }
+}
+//submit writes that are still batched
+void FileWriter::kick(){
+}
+//wait until every write queued on file has landed
+void FileWriter::wait(int file){
+    kick();
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this, file]{ return files[file].pending == 0; });
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+}
+//true when no write is pending on file, lets callers close finished files without blocking
+bool FileWriter::isIdle(int file){
+    std::unique_lock<std::mutex> guard(lock);
+    return files[file].pending == 0;
+}
+//wait until every queued write has landed
+void FileWriter::drain(){
+    kick();
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this]{ return pending == 0; });
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+}
+//account a new write, returns the size to write (padded for direct I/O)
+size_t FileWriter::started(int file, size_t size){
+    std::unique_lock<std::mutex> guard(lock);
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+    ++files[file].pending;
+    ++pending;
+    return files[file].direct ? alignUp(size) : size;
+}
+void FileWriter::completed(int file, const WriteDone &done, const std::string &failure){
+    if(done){
+        done();
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if(!failure.empty() && error.empty()){
+            error = failure;
+        }
+        --files[file].pending;
+        --pending;
+    }
+    cond.notify_all();
+}
+FileWriter::Native FileWriter::native(int file){
+    std::unique_lock<std::mutex> guard(lock);
+    return files[file].handle;
+}
+//copied under the lock, open() may grow files from another thread
+std::string FileWriter::filePath(int file){
+    std::unique_lock<std::mutex> guard(lock);
+    return files[file].path;
+}
+#ifdef FILEWRITER_POSIX
+void FileWriter::writeFully(int file, const uint8_t *buf, size_t size, uint64_t offset){
+    Native handle = native(file);
+    size_t done = 0;
+    while(done < size){
+        ssize_t n = pwrite(handle, buf + done, size - done, offset + done);
+        if(n <= 0){
+            throw std::runtime_error("write failed on " + filePath(file));
+        }
+        done += n;
+    }
+}
+#else
+void FileWriter::writeFully(int file, const uint8_t *buf, size_t size, uint64_t offset){
+    Native handle = native(file);
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD n = 0;
+    if(!WriteFile(handle, buf, (DWORD)size, &n, &ov) || n != size){
+        throw std::runtime_error("write failed on " + filePath(file));
+    }
+}
+#endif
+
+//portable backend, a few threads doing blocking positional writes
+class ThreadPoolWriter : public FileWriter{
+    public:
+        ThreadPoolWriter(unsigned int threads = 4);
+        ~ThreadPoolWriter();
+        void write(int file, const uint8_t *buf, size_t size, uint64_t offset, WriteDone done);
+        std::string getName();
+    private:
+        struct Request{
+            int file;
+            const uint8_t *buf;
+            size_t size;
+            uint64_t offset;
+            WriteDone done;
+        };
+        void workerLoop();
+        std::deque<Request> requests;
+        std::vector<std::thread> workers;
+        bool quit;
+};
+ThreadPoolWriter::ThreadPoolWriter(unsigned int threads){
+    quit = false;
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&ThreadPoolWriter::workerLoop, this));
+    }
+}
+ThreadPoolWriter::~ThreadPoolWriter(){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+    }
+    cond.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+/**
+ * @brief queue a write, buf must stay untouched until done is called
+ *
+ * @param file file id
+ * @param buf bytes to write
+ * @param size number of bytes, rounded up to WRITER_ALIGN on direct files
+ * @param offset position in the file, WRITER_ALIGN aligned on direct files
+ * @param done completion, may be empty
+ */
+void ThreadPoolWriter::write(int file, const uint8_t *buf, size_t size, uint64_t offset, WriteDone done){
+    Request r;
+    r.file = file;
+    r.buf = buf;
+    r.size = started(file, size);
+    r.offset = offset;
+    r.done = done;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        requests.push_back(r);
+    }
+    cond.notify_all();
+}
+void ThreadPoolWriter::workerLoop(){
+    Trace::instance().nameThread("file writer");
+    while(true){
+        Request r;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this]{ return quit || !requests.empty(); });
+            if(requests.empty()){
+                return;
+            }
+            r = requests.front();
+            requests.pop_front();
+        }
+        std::string failure;
+        try {
+            TraceSpan span("write", "write", "bytes", r.size, "file", r.file);
+            writeFully(r.file, r.buf, r.size, r.offset);
+        }
+        catch (const std::exception &e) {
+            failure = e.what();
+        }
+        completed(r.file, r.done, failure);
+    }
+}
+std::string ThreadPoolWriter::getName(){
+    return "thread pool";
+}
+
+#ifdef FILEWRITER_URING
+//Linux backend, writes are batched into one io_uring submission and completions are reaped on a dedicated thread
+class UringWriter : public FileWriter{
+    public:
+        UringWriter(unsigned int depth = 64, unsigned int batch = 8);
+        ~UringWriter();
+        void write(int file, const uint8_t *buf, size_t size, uint64_t offset, WriteDone done);
+        void kick();
+        std::string getName();
+    private:
+        struct Request{
+            int file;
+            const uint8_t *buf;
+            size_t size;
+            uint64_t offset;
+            WriteDone done;
+            uint64_t queuedAt; //host ns, the trace shows each write from queueing to completion
+        };
+        void reaperLoop();
+        struct io_uring ring;
+        std::mutex submitLock; //one submitter at a time, the reaper only touches the completion queue
+        std::thread reaper;
+        unsigned int depth;
+        unsigned int batch;
+        unsigned int queued; //prepared but not yet submitted
+        unsigned int inflight;
+        bool quit;
+};
+/**
+ * @brief Construct a new UringWriter:: UringWriter object
+ *
+ * @param depth1 writes in flight at most
+ * @param batch1 writes prepared before one io_uring_submit
+ */
+UringWriter::UringWriter(unsigned int depth1, unsigned int batch1){
+    depth = depth1;
+    batch = batch1;
+    queued = 0;
+    inflight = 0;
+    quit = false;
+    if(io_uring_queue_init(depth + 1, &ring, 0) < 0){ //one spare entry for the shutdown nop
+        throw std::runtime_error("io_uring_queue_init failed");
+    }
+    reaper = std::thread(&UringWriter::reaperLoop, this);
+}
+UringWriter::~UringWriter(){
+    drain();
+    {
+        std::unique_lock<std::mutex> guard(submitLock);
+        quit = true;
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data(sqe, NULL);
+        io_uring_submit(&ring);
+    }
+    reaper.join();
+    io_uring_queue_exit(&ring);
+}
+void UringWriter::write(int file, const uint8_t *buf, size_t size, uint64_t offset, WriteDone done){
+    Request *r = new Request();
+    r->file = file;
+    r->buf = buf;
+    r->size = started(file, size);
+    r->offset = offset;
+    r->done = done;
+    r->queuedAt = Trace::instance().isEnabled() ? Tools::getTimestampNs() : 0;
+    std::unique_lock<std::mutex> guard(submitLock);
+    {
+        std::unique_lock<std::mutex> count(lock);
+        if(inflight + queued >= depth && queued){ //make room, the reaper can only free what was submitted
+            io_uring_submit(&ring);
+            inflight += queued;
+            queued = 0;
+        }
+        cond.wait(count, [this]{ return inflight + queued < depth; });
+    }
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_write(sqe, native(file), r->buf, r->size, r->offset);
+    io_uring_sqe_set_data(sqe, r);
+    std::unique_lock<std::mutex> count(lock);
+    if(++queued >= batch){
+        io_uring_submit(&ring);
+        inflight += queued;
+        queued = 0;
+    }
+}
+void UringWriter::kick(){
+    std::unique_lock<std::mutex> guard(submitLock);
+    std::unique_lock<std::mutex> count(lock);
+    if(queued){
+        io_uring_submit(&ring);
+        inflight += queued;
+        queued = 0;
+    }
+}
+void UringWriter::reaperLoop(){
+    Trace::instance().nameThread("io_uring reaper");
+    while(true){
+        struct io_uring_cqe *cqe;
+        if(io_uring_wait_cqe(&ring, &cqe) < 0){
+            continue;
+        }
+        Request *r = (Request *)io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        if(r == NULL){
+            if(quit){
+                return;
+            }
+            continue;
+        }
+        std::string failure;
+        if(res < 0){
+            failure = "write failed on " + filePath(r->file) + ": " + strerror(-res);
+        }
+        else if((size_t)res < r->size){ //short write, finish it synchronously
+            try {
+                writeFully(r->file, r->buf + res, r->size - res, r->offset + res);
+            }
+            catch (const std::exception &e) {
+                failure = e.what();
+            }
+        }
+        {
+            std::unique_lock<std::mutex> count(lock);
+            --inflight;
+        }
+        if(r->queuedAt){
+            Trace::instance().complete("write", "write", r->queuedAt, Tools::getTimestampNs(), "bytes", r->size, "file", r->file);
+        }
+        completed(r->file, r->done, failure);
+        delete r;
+    }
+}
+std::string UringWriter::getName(){
+    return "io_uring";
+}
+#endif
+
+/**
+ * @brief best backend available on this machine
+ *
+ * @param threads worker threads of the fallback backend
+ * @return FileWriter* to delete when done
+ */
+inline FileWriter *createFileWriter(unsigned int threads = 4){
+#ifdef FILEWRITER_URING
+    try {
+        return new UringWriter();
+    }
+    catch (const std::exception &) { //kernel without io_uring
+    }
+#endif
+    return new ThreadPoolWriter(threads);
+}
+#endif
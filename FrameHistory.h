@@ -0,0 +1,667 @@
+/**
+ * @file FrameHistory.h
+ * @author Ori Garibi
+ * @brief compressed RAM ring of acquired frames (delta against the previous frame plus a fast codec), decoded in parallel for saving
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef FRAMEHISTORY_H
+#define FRAMEHISTORY_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include "Trace.h"
+#if defined(WITH_LZ4) //build with -DWITH_LZ4 -llz4
+#include <lz4.h>
+#define FRAMEHISTORY_LZ4
+#endif
+
+//bytes 0x80 of every lane, for byte-wise arithmetic on 64 bit words
+static const uint64_t HISTORY_HIGH = 0x8080808080808080ull;
+
+//a - b on each of the 8 bytes, no borrow across bytes
+inline uint64_t byteSub(uint64_t a, uint64_t b){
+    return ((a | HISTORY_HIGH) - (b & ~HISTORY_HIGH)) ^ ((a ^ ~b) & HISTORY_HIGH);
+}
+//a + b on each of the 8 bytes, no carry across bytes
+inline uint64_t byteAdd(uint64_t a, uint64_t b){
+    return ((a & ~HISTORY_HIGH) + (b & ~HISTORY_HIGH)) ^ ((a ^ b) & HISTORY_HIGH);
+}
+inline uint64_t loadWord(const uint8_t *p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+inline void storeWord(uint8_t *p, uint64_t v){
+    memcpy(p, &v, 8);
+}
+inline size_t putVarint(uint8_t *p, uint64_t v){
+    size_t n = 0;
+    while(v >= 0x80){
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+inline uint64_t getVarint(const uint8_t *&p, const uint8_t *end){
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)){
+            return v;
+        }
+    }
+    throw std::runtime_error("corrupt history frame");
+}
+
+//worst case size of one encoded part
+inline size_t zeroRunBound(size_t size){
+    return size + size/8 + 32;
+}
+/**
+ * @brief delta against the previous frame as runs of zero words and literal words: varint zeros, varint literals, literal bytes
+ *
+ * A static scene gives long runs of zero words that cost a couple of bytes each, noise stays as literals.
+ *
+ * @param cur part of the current frame
+ * @param prev same part of the previous frame, NULL for a key frame
+ * @param size bytes of the part
+ * @param out zeroRunBound(size) bytes
+ * @return size_t encoded bytes
+ */
+inline size_t zeroRunEncode(const uint8_t *cur, const uint8_t *prev, size_t size, uint8_t *out){
+    const size_t words = size/8;
+    size_t o = 0;
+    size_t w = 0;
+    while(w < words){
+        size_t zeros = 0;
+        while(w < words && (prev ? byteSub(loadWord(cur + 8*w), loadWord(prev + 8*w)) : loadWord(cur + 8*w)) == 0){
+            ++zeros;
+            ++w;
+        }
+        const size_t first = w;
+        while(w < words && (prev ? byteSub(loadWord(cur + 8*w), loadWord(prev + 8*w)) : loadWord(cur + 8*w)) != 0){
+            ++w;
+        }
+        o += putVarint(out + o, zeros);
+        o += putVarint(out + o, w - first);
+        for (size_t k = first; k < w; k++)
+        {
+            storeWord(out + o, prev ? byteSub(loadWord(cur + 8*k), loadWord(prev + 8*k)) : loadWord(cur + 8*k));
+            o += 8;
+        }
+    }
+    for (size_t k = words*8; k < size; k++) //tail bytes are stored as they are
+    {
+        out[o++] = (uint8_t)(cur[k] - (prev ? prev[k] : 0));
+    }
+    return o;
+}
+/**
+ * @brief apply an encoded part to the reference, which then holds the frame
+ *
+ * @param in encoded part
+ * @param inSize encoded bytes
+ * @param ref previous frame on entry, current frame on return; overwritten for a key frame
+ * @param size bytes of the part
+ * @param key the part was encoded without a previous frame
+ */
+inline void zeroRunDecode(const uint8_t *in, size_t inSize, uint8_t *ref, size_t size, bool key){
+    const size_t words = size/8;
+    const uint8_t *p = in;
+    const uint8_t *end = in + inSize;
+    size_t w = 0;
+    while(w < words){
+        const uint64_t zeros = getVarint(p, end);
+        const uint64_t literals = getVarint(p, end);
+        if(zeros + literals > words - w || (size_t)(end - p) < 8*literals){
+            throw std::runtime_error("corrupt history frame");
+        }
+        if(key){
+            memset(ref + 8*w, 0, 8*zeros);
+        }
+        w += zeros; //unchanged words cost nothing on a delta frame
+        for (uint64_t k = 0; k < literals; k++, w++, p += 8)
+        {
+            storeWord(ref + 8*w, key ? loadWord(p) : byteAdd(loadWord(ref + 8*w), loadWord(p)));
+        }
+    }
+    for (size_t k = words*8; k < size; k++)
+    {
+        if(p >= end){
+            throw std::runtime_error("corrupt history frame");
+        }
+        ref[k] = (uint8_t)(*p++ + (key ? 0 : ref[k]));
+    }
+}
+
+//acquired frames are compressed on a pool of workers straight from the grabber buffers, which the caller holds until getSettled() passes them, and decoded in parallel for saving
+class FrameHistory{
+    public:
+        FrameHistory(int numParts, size_t partSize, unsigned int hotWindow, unsigned int threads = 4, unsigned int keyEvery = 8, size_t blockSize = 64 << 20);
+        ~FrameHistory();
+        void store(unsigned int seq, uint8_t *const parts[]);
+        void release(unsigned int seq);
+        unsigned int getSettled();
+        void flush();
+        void beginDecode(unsigned int first, unsigned int count);
+        uint8_t *get(unsigned int seq);
+        void recycle(unsigned int seq);
+        uint64_t getBytes();
+        uint64_t getRawBytes();
+        uint64_t getCompressedBytes();
+        unsigned int getStalls();
+        std::string getCodec();
+    private:
+        struct Entry{
+            bool ready; //compressed
+            bool dropped; //released before the worker was done
+            bool key;
+            size_t block;
+            size_t offset;
+            std::vector<size_t> sizes; //encoded bytes of each part
+        };
+        struct Block{
+            uint8_t *data;
+            size_t used;
+            unsigned int live; //entries stored in this block
+        };
+        struct Job{
+            unsigned int seq;
+            std::vector<uint8_t *> parts;
+            std::vector<uint8_t *> prev; //empty for a key frame
+        };
+        void compressLoop();
+        void decodeLoop();
+        size_t encodePart(const uint8_t *cur, const uint8_t *prev, uint8_t *out);
+        void decodePart(const uint8_t *in, size_t inSize, uint8_t *ref, bool key, uint8_t *scratch);
+        void freeEntry(std::map<unsigned int, Entry>::iterator it);
+        void fail(const std::string &what);
+        int numParts;
+        size_t partSize;
+        size_t frameSize;
+        size_t frameBound; //worst case encoded frame
+        unsigned int hotWindow;
+        unsigned int keyEvery;
+        size_t blockSize;
+        std::vector<uint8_t *> last; //parts of the previous stored frame, the delta reference
+        bool haveLast;
+        unsigned int lastSeq;
+        std::map<unsigned int, Entry> entries;
+        std::vector<Block> blocks;
+        std::vector<size_t> freeBlocks;
+        size_t current; //block being filled
+        std::deque<Job> jobs;
+        unsigned int pending; //stored but not compressed yet
+        std::set<unsigned int> compressing; //sequence numbers of those frames
+        unsigned int stalls;
+        uint64_t rawBytes;
+        uint64_t compressedBytes;
+        std::vector<std::thread> workers;
+        unsigned int threads;
+        bool quit;
+        //decoding
+        unsigned int first;
+        unsigned int count;
+        unsigned int nextGroup;
+        unsigned int consumed; //frames recycled by the save loop
+        unsigned int window; //decoded frames allowed ahead of the save loop
+        std::vector<uint8_t *> slots;
+        std::vector<uint8_t *> freeSlots;
+        std::map<unsigned int, uint8_t *> decoded;
+        std::vector<std::thread> decoders;
+        std::string error;
+        std::mutex lock;
+        std::condition_variable cond;
+};
+/**
+ * @brief Construct a new FrameHistory:: FrameHistory object and start the compression workers
+ *
+ * @param numParts1 grabbers, one part each
+ * @param partSize1 bytes of one grabber buffer
+ * @param hotWindow1 frames that may wait for compression; the caller holds their grabber buffers meanwhile, so keep it under half the announced buffers
+ * @param threads1 compression and decompression workers
+ * @param keyEvery1 a key frame every keyEvery1 frames, groups are decoded independently
+ * @param blockSize1 allocation unit of the ring
+ */
+FrameHistory::FrameHistory(int numParts1, size_t partSize1, unsigned int hotWindow1, unsigned int threads1, unsigned int keyEvery1, size_t blockSize1){
+    if(hotWindow1 == 0 || keyEvery1 == 0 || threads1 == 0){
+        throw std::runtime_error("frame history needs a hot window, a key interval and workers");
+    }
+    numParts = numParts1;
+    partSize = partSize1;
+    hotWindow = hotWindow1;
+    threads = threads1;
+    keyEvery = keyEvery1;
+#ifdef FRAMEHISTORY_LZ4
+    const size_t bound = LZ4_compressBound((int)partSize);
+#else
+    const size_t bound = zeroRunBound(partSize);
+#endif
+    frameSize = numParts*partSize;
+    frameBound = numParts*bound;
+    blockSize = blockSize1 > frameBound ? blockSize1 : frameBound; //any frame fits in one block
+    last.assign(numParts, (uint8_t *)NULL);
+    haveLast = false;
+    lastSeq = 0;
+    current = 0;
+    pending = 0;
+    stalls = 0;
+    rawBytes = 0;
+    compressedBytes = 0;
+    quit = false;
+    first = 0;
+    count = 0;
+    nextGroup = 0;
+    consumed = 0;
+    window = 0;
+    Block b;
+    b.data = new uint8_t[blockSize];
+    b.used = 0;
+    b.live = 0;
+    blocks.push_back(b);
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&FrameHistory::compressLoop, this));
+    }
+}
+FrameHistory::~FrameHistory(){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+        if(error.empty()){
+            error = "frame history closed";
+        }
+    }
+    cond.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    for (size_t i = 0; i < decoders.size(); i++)
+    {
+        decoders[i].join();
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        delete[] blocks[i].data;
+    }
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        delete[] slots[i];
+    }
+}
+/**
+ * @brief queue a frame for compression, the grabber buffers are read later by a worker
+ *
+ * @param seq frame sequence number, consecutive across calls
+ * @param parts grabber buffer of each part, not requeued before getSettled() is past seq: the worker reads it and the next frame uses it as its delta reference
+ */
+void FrameHistory::store(unsigned int seq, uint8_t *const parts[]){
+    Job job;
+    job.seq = seq;
+    job.parts.assign(parts, parts + numParts);
+    const bool key = !haveLast || seq != lastSeq + 1 || seq % keyEvery == 0;
+    if(!key){
+        job.prev = last;
+    }
+    last = job.parts;
+    haveLast = true;
+    lastSeq = seq;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if(pending >= hotWindow){ //workers behind, the caller holds a grabber buffer per pending frame
+            ++stalls;
+            TraceSpan span("history stall", "acquire", "frame", seq);
+            cond.wait(guard, [this]{ return pending < hotWindow || !error.empty(); });
+        }
+        if(!error.empty()){
+            throw std::runtime_error(error);
+        }
+        Entry e;
+        e.ready = false;
+        e.dropped = false;
+        e.key = key;
+        e.block = 0;
+        e.offset = 0;
+        entries[seq] = e;
+        jobs.push_back(job);
+        compressing.insert(seq);
+        ++pending;
+    }
+    cond.notify_all();
+}
+/**
+ * @brief drop the oldest frame; memory is given back a whole key group at a time since later frames need it
+ *
+ * @param seq frame sequence number, released oldest first
+ */
+void FrameHistory::release(unsigned int seq){
+    std::unique_lock<std::mutex> guard(lock);
+    if((seq + 1) % keyEvery != 0){
+        return;
+    }
+    std::map<unsigned int, Entry>::iterator it = entries.begin();
+    while(it != entries.end() && it->first <= seq){
+        std::map<unsigned int, Entry>::iterator next = it;
+        ++next;
+        freeEntry(it);
+        it = next;
+    }
+}
+/**
+ * @brief frames whose grabber buffers are no longer read: compressed, and so is the next frame that uses them as its reference
+ *
+ * @return unsigned int the buffers of every frame before this sequence number can be requeued
+ */
+unsigned int FrameHistory::getSettled(){
+    std::unique_lock<std::mutex> guard(lock);
+    if(!haveLast){
+        return 0;
+    }
+    unsigned int next = lastSeq + 1; //last is the reference of the frame stored after it
+    if(!compressing.empty() && *compressing.begin() < next){
+        next = *compressing.begin();
+    }
+    return next ? next - 1 : 0;
+}
+//lock must be held
+void FrameHistory::freeEntry(std::map<unsigned int, Entry>::iterator it){
+    if(!it->second.ready){ //still with a worker, it drops the result
+        it->second.dropped = true;
+        return;
+    }
+    Block &b = blocks[it->second.block];
+    if(--b.live == 0){
+        b.used = 0;
+        if(it->second.block != current){
+            freeBlocks.push_back(it->second.block);
+        }
+    }
+    entries.erase(it);
+}
+void FrameHistory::fail(const std::string &what){
+    std::unique_lock<std::mutex> guard(lock);
+    if(error.empty()){
+        error = what;
+    }
+    cond.notify_all();
+}
+size_t FrameHistory::encodePart(const uint8_t *cur, const uint8_t *prev, uint8_t *out){
+#ifdef FRAMEHISTORY_LZ4
+    thread_local std::vector<uint8_t> delta;
+    delta.resize(partSize);
+    const size_t words = partSize/8;
+    for (size_t k = 0; k < words; k++)
+    {
+        storeWord(&delta[8*k], prev ? byteSub(loadWord(cur + 8*k), loadWord(prev + 8*k)) : loadWord(cur + 8*k));
+    }
+    for (size_t k = words*8; k < partSize; k++)
+    {
+        delta[k] = (uint8_t)(cur[k] - (prev ? prev[k] : 0));
+    }
+    int n = LZ4_compress_default((const char *)delta.data(), (char *)out, (int)partSize, LZ4_compressBound((int)partSize));
+    if(n <= 0){
+        throw std::runtime_error("LZ4 compression failed");
+    }
+    return n;
+#else
+    return zeroRunEncode(cur, prev, partSize, out);
+#endif
+}
+void FrameHistory::decodePart(const uint8_t *in, size_t inSize, uint8_t *ref, bool key, uint8_t *scratch){
+#ifdef FRAMEHISTORY_LZ4
+    if(LZ4_decompress_safe((const char *)in, (char *)scratch, (int)inSize, (int)partSize) != (int)partSize){
+        throw std::runtime_error("corrupt history frame");
+    }
+    const size_t words = partSize/8;
+    for (size_t k = 0; k < words; k++)
+    {
+        storeWord(ref + 8*k, key ? loadWord(scratch + 8*k) : byteAdd(loadWord(ref + 8*k), loadWord(scratch + 8*k)));
+    }
+    for (size_t k = words*8; k < partSize; k++)
+    {
+        ref[k] = (uint8_t)(scratch[k] + (key ? 0 : ref[k]));
+    }
+#else
+    (void)scratch;
+    zeroRunDecode(in, inSize, ref, partSize, key);
+#endif
+}
+void FrameHistory::compressLoop(){
+    Trace::instance().nameThread("history compress");
+    std::vector<uint8_t> out(frameBound);
+    while(true){
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this]{ return quit || !jobs.empty(); });
+            if(jobs.empty()){
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        std::vector<size_t> sizes(numParts);
+        size_t total = 0;
+        try {
+            TraceSpan span("compress", "history", "frame", job.seq);
+            for (int i = 0; i < numParts; i++)
+            {
+                sizes[i] = encodePart(job.parts[i], job.prev.empty() ? NULL : job.prev[i], &out[total]);
+                total += sizes[i];
+            }
+        }
+        catch (const std::exception &e) {
+            fail(e.what());
+        }
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            --pending;
+            compressing.erase(job.seq);
+            std::map<unsigned int, Entry>::iterator it = entries.find(job.seq);
+            if(it != entries.end() && it->second.dropped){
+                entries.erase(it);
+            }
+            else if(it != entries.end() && error.empty()){
+                if(blocks[current].used + total > blockSize){ //next block, reusing one that has been emptied
+                    if(blocks[current].live == 0){
+                        blocks[current].used = 0;
+                    }
+                    else if(!freeBlocks.empty()){
+                        current = freeBlocks.back();
+                        freeBlocks.pop_back();
+                    }
+                    else{
+                        Block b;
+                        b.data = new uint8_t[blockSize];
+                        b.used = 0;
+                        b.live = 0;
+                        blocks.push_back(b);
+                        current = blocks.size() - 1;
+                    }
+                }
+                Block &b = blocks[current];
+                memcpy(b.data + b.used, out.data(), total); //copied under the lock, a block never moves
+                it->second.block = current;
+                it->second.offset = b.used;
+                it->second.sizes = sizes;
+                it->second.ready = true;
+                b.used += total;
+                ++b.live;
+                rawBytes += frameSize;
+                compressedBytes += total;
+            }
+        }
+        cond.notify_all();
+    }
+}
+//wait until every stored frame is compressed
+void FrameHistory::flush(){
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this]{ return pending == 0 || !error.empty(); });
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+}
+/**
+ * @brief start decoding frames first..first+count-1 on the workers, call flush() first
+ *
+ * @param first1 oldest frame to save
+ * @param count1 frames to save, consecutive
+ */
+void FrameHistory::beginDecode(unsigned int first1, unsigned int count1){
+    flush();
+    std::unique_lock<std::mutex> guard(lock);
+    first = first1;
+    count = count1;
+    consumed = 0;
+    nextGroup = first/keyEvery;
+    window = (threads + 1)*keyEvery; //every worker can run ahead by a whole group
+    if(window > count){
+        window = count ? count : 1;
+    }
+    while(slots.size() < window){
+        slots.push_back(new uint8_t[frameSize]);
+        freeSlots.push_back(slots.back());
+    }
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        decoders.push_back(std::thread(&FrameHistory::decodeLoop, this));
+    }
+}
+void FrameHistory::decodeLoop(){
+    Trace::instance().nameThread("history decode");
+    std::vector<uint8_t> ref(frameSize);
+    std::vector<uint8_t> scratch(partSize);
+    while(true){
+        unsigned int group;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            group = nextGroup;
+            if(quit || !error.empty() || (uint64_t)group*keyEvery >= (uint64_t)first + count){
+                return;
+            }
+            ++nextGroup;
+        }
+        try {
+            bool started = false;
+            for (unsigned int seq = group*keyEvery; seq < (group + 1)*keyEvery && seq < first + count; seq++)
+            {
+                Entry e;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    std::map<unsigned int, Entry>::iterator it = entries.find(seq);
+                    if(it == entries.end()){ //before the first stored frame of the trial
+                        continue;
+                    }
+                    e = it->second;
+                }
+                if(!started && !e.key){
+                    throw std::runtime_error("history group " + std::to_string(group) + " has lost its key frame");
+                }
+                started = true;
+                TraceSpan span("decode", "history", "frame", seq);
+                const uint8_t *in = blocks[e.block].data + e.offset; //blocks of stored frames are not touched while decoding
+                for (int i = 0; i < numParts; i++)
+                {
+                    decodePart(in, e.sizes[i], &ref[i*partSize], e.key, scratch.data());
+                    in += e.sizes[i];
+                }
+                span.end();
+                if(seq < first){ //only needed as a reference
+                    continue;
+                }
+                uint8_t *slot;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    cond.wait(guard, [this, seq]{ return seq < first + consumed + window || quit || !error.empty(); }); //a slot is free once the save loop is close
+                    if(quit || !error.empty()){
+                        return;
+                    }
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+                memcpy(slot, ref.data(), frameSize);
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    decoded[seq] = slot;
+                }
+                cond.notify_all();
+            }
+        }
+        catch (const std::exception &e) {
+            fail(e.what());
+            return;
+        }
+    }
+}
+/**
+ * @brief decoded frame, waits for the workers; frames must be taken in order
+ *
+ * @param seq frame sequence number
+ * @return uint8_t* numParts parts of partSize bytes, valid until recycle(seq)
+ */
+uint8_t *FrameHistory::get(unsigned int seq){
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this, seq]{ return decoded.count(seq) || !error.empty(); });
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+    return decoded[seq];
+}
+//give the buffer of a saved frame back to the decoders
+void FrameHistory::recycle(unsigned int seq){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        std::map<unsigned int, uint8_t *>::iterator it = decoded.find(seq);
+        if(it == decoded.end()){
+            return;
+        }
+        freeSlots.push_back(it->second);
+        decoded.erase(it);
+        ++consumed;
+    }
+    cond.notify_all();
+}
+//RAM held by the ring
+uint64_t FrameHistory::getBytes(){
+    std::unique_lock<std::mutex> guard(lock);
+    return (uint64_t)blocks.size()*blockSize;
+}
+//uncompressed bytes of every frame compressed so far
+uint64_t FrameHistory::getRawBytes(){
+    std::unique_lock<std::mutex> guard(lock);
+    return rawBytes;
+}
+uint64_t FrameHistory::getCompressedBytes(){
+    std::unique_lock<std::mutex> guard(lock);
+    return compressedBytes;
+}
+unsigned int FrameHistory::getStalls(){
+    std::unique_lock<std::mutex> guard(lock);
+    return stalls;
+}
+std::string FrameHistory::getCodec(){
+#ifdef FRAMEHISTORY_LZ4
+    return "delta + LZ4";
+#else
+    return "delta + zero runs";
+#endif
+}
+#endif
@@ -0,0 +1,422 @@
+/**
+ * @file JpegEncoder.h
+ * @author Ori Garibi
+ * @brief parallel JPEG encoding of stitched frames with long-lived TurboJPEG contexts, output delivered in frame order
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef JPEGENCODER_H
+#define JPEGENCODER_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <stdexcept>
+#include <turbojpeg.h> //libjpeg-turbo, link with -lturbojpeg
+#include <D:\Euresys\eGrabber\include\EGrabber.h>
+#include <D:\Euresys\eGrabber\include\FormatConverter.h>
+#include "FileWriter.h"
+#include "Crc32c.h"
+#include "Trace.h"
+
+/**
+ * @brief replace the run of N in a pattern by the zero padded index, "frame.NNN.jpeg" -> "frame.007.jpeg"
+ *
+ * @param pattern file name pattern, same convention as FormatConverter::Auto::saveToDisk
+ * @param index frame index
+ * @return std::string file name
+ */
+inline std::string framePath(const std::string &pattern, int64_t index){
+    size_t first = pattern.find("NNN");
+    if(first == std::string::npos){
+        return pattern;
+    }
+    size_t last = pattern.find_first_not_of('N', first);
+    if(last == std::string::npos){
+        last = pattern.size();
+    }
+    std::stringstream ss;
+    ss << pattern.substr(0, first) << std::setw(last - first) << std::setfill('0') << index << pattern.substr(last);
+    return ss.str();
+}
+
+//bytes and CRC32C of one frame as it is stored in the file
+struct FrameChecksum{
+    int64_t index;
+    uint64_t size;
+    uint32_t crc;
+};
+
+//receives encoded frames in frame order; done must be called once data can be reused
+class FrameSink{
+    public:
+        virtual ~FrameSink(){}
+        virtual void put(int64_t index, const uint8_t *data, size_t size, WriteDone done) = 0;
+        virtual void setFrameTime(int64_t, uint64_t){} //Record timestamp of a frame, for containers that keep timing
+        virtual void finish() = 0;
+        void saveChecksums(const std::string &path);
+    protected:
+        void logChecksum(int64_t index, uint64_t size, uint32_t crc);
+    private:
+        std::vector<FrameChecksum> checksums;
+};
+//called by put with the CRC of the bytes it stores
+void FrameSink::logChecksum(int64_t index, uint64_t size, uint32_t crc){
+    FrameChecksum c;
+    c.index = index;
+    c.size = size;
+    c.crc = crc;
+    checksums.push_back(c);
+}
+/**
+ * @brief write the checksum of every stored frame, read back by the verify tool; call after finish()
+ *
+ * @param path CSV file, one row per frame: index, bytes, CRC32C
+ */
+void FrameSink::saveChecksums(const std::string &path){
+    std::ofstream out(path.c_str());
+    out << "Image Index,Bytes,CRC32C\n";
+    for (size_t i = 0; i < checksums.size(); i++)
+    {
+        out << checksums[i].index << "," << checksums[i].size << "," << crc32cHex(checksums[i].crc) << "\n";
+    }
+    if(!out){
+        throw std::runtime_error("could not write " + path);
+    }
+}
+
+//one file per frame, named from a frame.NNN.jpeg pattern
+class JpegFileSink : public FrameSink{
+    public:
+        JpegFileSink(FileWriter &writer, const std::string &pattern);
+        ~JpegFileSink();
+        void put(int64_t index, const uint8_t *data, size_t size, WriteDone done);
+        void finish();
+    private:
+        void closeIdle(bool all);
+        FileWriter &writer;
+        std::string pattern;
+        std::deque<std::pair<int, size_t> > open; //files whose write may still be in flight
+};
+JpegFileSink::JpegFileSink(FileWriter &writer1, const std::string &pattern1) : writer(writer1){
+    pattern = pattern1;
+}
+JpegFileSink::~JpegFileSink(){
+}
+/**
+ * @brief write one encoded frame to its own file
+ *
+ * @param index frame index, fills the NNN of the pattern
+ * @param data encoded bytes, from alignedAlloc so the file can use direct I/O
+ * @param size number of encoded bytes
+ * @param done called once the write has landed
+ */
+void JpegFileSink::put(int64_t index, const uint8_t *data, size_t size, WriteDone done){
+    closeIdle(false);
+    logChecksum(index, size, crc32c(0, data, size));
+    int file = writer.open(framePath(pattern, index), 0, true);
+    writer.write(file, data, size, 0, done);
+    open.push_back(std::make_pair(file, size));
+}
+void JpegFileSink::finish(){
+    closeIdle(true);
+}
+//close files in order as their write lands, all of them when all is set
+void JpegFileSink::closeIdle(bool all){
+    while(!open.empty() && (all || writer.isIdle(open.front().first))){
+        writer.close(open.front().first, open.front().second);
+        open.pop_front();
+    }
+}
+
+//stitched frames are encoded by a pool of workers, each with its own TurboJPEG handle and converter
+class JpegEncoder{
+    public:
+        JpegEncoder(Euresys::EGenTL &genTL, FrameSink &sink, const std::string &format, size_t width, size_t height, size_t pitch,
+                    int quality = 90, int subsampling = TJSAMP_420, unsigned int threads = 4, bool grayscale = false, bool fastDct = false);
+        ~JpegEncoder();
+        uint8_t *acquire();
+        void submit(uint8_t *frame, int64_t index);
+        void finish();
+        size_t getFrameSize();
+    private:
+        struct Job{
+            uint64_t seq;
+            int64_t index;
+            uint8_t *frame;
+        };
+        struct Encoded{
+            int64_t index;
+            uint8_t *data;
+            size_t size;
+        };
+        void workerLoop();
+        void deliver();
+        void check();
+        FrameSink &sink;
+        std::string format;
+        size_t width;
+        size_t height;
+        size_t pitch;
+        int quality;
+        int subsampling;
+        int pixelFormat; //-1 when the frame goes through FormatConverter first
+        int flags; //TurboJPEG flags of every frame
+        size_t frameSize;
+        size_t outSize;
+        Euresys::EGenTL &genTL;
+        std::vector<std::thread> workers;
+        std::vector<uint8_t *> frames; //stitching destinations
+        std::vector<uint8_t *> outputs; //encoder output buffers
+        std::vector<uint8_t *> freeFrames;
+        std::vector<uint8_t *> freeOutputs;
+        std::deque<Job> jobs;
+        std::map<uint64_t, Encoded> ready;
+        uint64_t submitted;
+        uint64_t delivered;
+        uint64_t written;
+        bool delivering;
+        bool quit;
+        std::string error;
+        std::mutex lock;
+        std::condition_variable cond;
+};
+/**
+ * @brief Construct a new JpegEncoder:: JpegEncoder object and start the workers
+ *
+ * @param genTL1 GenTL producer, used for the converters of formats TurboJPEG cannot take directly
+ * @param sink1 destination of the encoded frames
+ * @param format1 pixel format of the stitched frame
+ * @param width1 pixels per line
+ * @param height1 lines of the stitched frame
+ * @param pitch1 bytes between two lines
+ * @param quality1 JPEG quality 1..100
+ * @param subsampling1 chroma subsampling (TJSAMP_444, TJSAMP_422, TJSAMP_420), ignored for grayscale output
+ * @param threads number of encoder workers
+ * @param grayscale encode Mono8 as a one channel JPEG instead of the RGB JPEG downstream tools read
+ * @param fastDct faster, less accurate DCT; changes the pixels against the default encoder
+ */
+JpegEncoder::JpegEncoder(Euresys::EGenTL &genTL1, FrameSink &sink1, const std::string &format1, size_t width1, size_t height1, size_t pitch1,
+                         int quality1, int subsampling1, unsigned int threads, bool grayscale, bool fastDct) : sink(sink1), genTL(genTL1){
+    format = format1;
+    width = width1;
+    height = height1;
+    pitch = pitch1;
+    quality = quality1;
+    subsampling = subsampling1;
+    flags = TJFLAG_NOREALLOC | (fastDct ? TJFLAG_FASTDCT : 0);
+    if(format == "Mono8" && grayscale){
+        pixelFormat = TJPF_GRAY;
+        subsampling = TJSAMP_GRAY;
+    }
+    else if(format == "RGB8"){
+        pixelFormat = TJPF_RGB;
+    }
+    else if(format == "BGR8"){
+        pixelFormat = TJPF_BGR;
+    }
+    else{
+        pixelFormat = -1; //Mono8 included, converted to RGB8 like FormatConverter::Auto::saveToDisk did
+    }
+    frameSize = pitch*height;
+    outSize = tjBufSize(width, height, subsampling);
+    submitted = 0;
+    delivered = 0;
+    written = 0;
+    delivering = false;
+    quit = false;
+    for (unsigned int i = 0; i < threads + 2; i++) //two spare so stitching never waits on a busy pool
+    {
+        frames.push_back(alignedAlloc(frameSize));
+        freeFrames.push_back(frames.back());
+    }
+    for (unsigned int i = 0; i < 2*threads; i++) //one being encoded and one being written per worker
+    {
+        outputs.push_back(alignedAlloc(outSize));
+        freeOutputs.push_back(outputs.back());
+    }
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&JpegEncoder::workerLoop, this));
+    }
+}
+JpegEncoder::~JpegEncoder(){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+    }
+    cond.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        alignedFree(frames[i]);
+    }
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        alignedFree(outputs[i]);
+    }
+}
+//rethrow a worker failure on the calling thread, lock must be held
+void JpegEncoder::check(){
+    if(!error.empty()){
+        throw std::runtime_error(error);
+    }
+}
+/**
+ * @brief get a free frame buffer to stitch into, waits while every buffer is being encoded
+ *
+ * @return uint8_t* buffer of getFrameSize() bytes
+ */
+uint8_t *JpegEncoder::acquire(){
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this]{ return !freeFrames.empty() || !error.empty(); });
+    check();
+    uint8_t *frame = freeFrames.back();
+    freeFrames.pop_back();
+    return frame;
+}
+/**
+ * @brief queue a stitched frame for encoding, the buffer goes back to acquire() once encoded
+ *
+ * @param frame buffer from acquire()
+ * @param index frame index given to the sink
+ */
+void JpegEncoder::submit(uint8_t *frame, int64_t index){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        check();
+        Job job;
+        job.seq = submitted++;
+        job.index = index;
+        job.frame = frame;
+        jobs.push_back(job);
+    }
+    cond.notify_all();
+}
+//wait until every submitted frame has been written
+void JpegEncoder::finish(){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [this]{ return written == submitted || !error.empty(); });
+        check();
+    }
+    sink.finish();
+}
+size_t JpegEncoder::getFrameSize(){
+    return frameSize;
+}
+void JpegEncoder::workerLoop(){
+    Trace::instance().nameThread("jpeg encoder");
+    tjhandle handle = tjInitCompress(); //kept for the whole trial instead of one setup per frame
+    Euresys::FormatConverter *converter = pixelFormat < 0 ? new Euresys::FormatConverter(genTL) : NULL;
+    while(true){
+        Job job;
+        uint8_t *out;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this]{ return quit || (!jobs.empty() && !freeOutputs.empty()); });
+            if(jobs.empty() || freeOutputs.empty()){
+                break;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+            out = freeOutputs.back();
+            freeOutputs.pop_back();
+        }
+        unsigned long size = outSize;
+        std::string failure;
+        if(handle == NULL){
+            failure = "tjInitCompress failed";
+        }
+        else if(converter){
+            TraceSpan convert("convert", "encode", "frame", job.index);
+            Euresys::FormatConverter::Auto rgb(*converter, Euresys::FormatConverter::OutputFormat("RGB8"), job.frame, format, width, height, frameSize, pitch);
+            convert.end();
+            TraceSpan encode("encode", "encode", "frame", job.index);
+            if(tjCompress2(handle, rgb.getBuffer(), width, width*3, height, TJPF_RGB, &out, &size, subsampling, quality, flags)){
+                failure = tjGetErrorStr2(handle);
+            }
+        }
+        else{
+            TraceSpan encode("encode", "encode", "frame", job.index);
+            if(tjCompress2(handle, job.frame, width, pitch, height, pixelFormat, &out, &size, subsampling, quality, flags)){
+                failure = tjGetErrorStr2(handle);
+            }
+        }
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            freeFrames.push_back(job.frame);
+            if(!failure.empty() && error.empty()){
+                error = "jpeg encode of frame " + std::to_string(job.index) + " failed: " + failure;
+            }
+            Encoded e;
+            e.index = job.index;
+            e.data = out;
+            e.size = failure.empty() ? size : 0;
+            ready[job.seq] = e;
+        }
+        cond.notify_all();
+        deliver();
+    }
+    delete converter;
+    if(handle){
+        tjDestroy(handle);
+    }
+}
+//hand encoded frames to the sink in frame order, one thread at a time
+void JpegEncoder::deliver(){
+    std::unique_lock<std::mutex> guard(lock);
+    if(delivering){ //the thread already delivering will pick our frame up
+        return;
+    }
+    delivering = true;
+    while(ready.count(delivered)){
+        Encoded e = ready[delivered];
+        ready.erase(delivered);
+        ++delivered;
+        guard.unlock();
+        uint8_t *data = e.data;
+        WriteDone done = [this, data]{
+            {
+                std::unique_lock<std::mutex> g(lock);
+                freeOutputs.push_back(data); //encoder output buffer is reused once on disk
+                ++written;
+            }
+            cond.notify_all();
+        };
+        if(e.size){
+            try {
+                TraceSpan span("store", "write", "frame", e.index, "bytes", e.size);
+                sink.put(e.index, e.data, e.size, done);
+            }
+            catch (const std::exception &ex) {
+                guard.lock();
+                if(error.empty()){
+                    error = ex.what();
+                }
+                guard.unlock();
+                done();
+            }
+        }
+        else{
+            done();
+        }
+        guard.lock();
+    }
+    delivering = false;
+}
+#endif
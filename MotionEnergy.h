@@ -0,0 +1,187 @@
+/**
+ * @file MotionEnergy.h
+ * @author Ori Garibi
+ * @brief online frame-difference energy used to estimate reaction onset during acquisition
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef MOTIONENERGY_H
+#define MOTIONENERGY_H
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MOTIONENERGY_SSE2
+#endif
+
+//sum of absolute differences between two sub-images, sampled on a coarse grid so it fits the 1ms frame budget
+class MotionEnergy{
+    public:
+        MotionEnergy(size_t width, size_t height, size_t pitch, size_t rowStep = 8, size_t colStep = 64);
+        ~MotionEnergy();
+        uint64_t compute(const uint8_t *cur, const uint8_t *prev) const;
+    private:
+        size_t width;
+        size_t height;
+        size_t pitch;
+        size_t rowStep;
+        size_t colStep;
+};
+/**
+ * @brief Construct a new MotionEnergy:: MotionEnergy object
+ *
+ * @param width1 bytes per line that carry pixels
+ * @param height1 lines in one sub-image
+ * @param pitch1 bytes between the start of two lines
+ * @param rowStep1 sample one line every rowStep1 lines
+ * @param colStep1 sample one 16 byte block every colStep1 bytes, must be at least 16
+ */
+MotionEnergy::MotionEnergy(size_t width1, size_t height1, size_t pitch1, size_t rowStep1, size_t colStep1){
+    if(colStep1 < 16 || rowStep1 == 0){
+        throw std::runtime_error("motion energy grid is too fine");
+    }
+    width = width1;
+    height = height1;
+    pitch = pitch1;
+    rowStep = rowStep1;
+    colStep = colStep1;
+}
+MotionEnergy::~MotionEnergy(){
+
+}
+/**
+ * @brief sum of absolute differences of 16 byte blocks on the grid
+ *
+ * @param cur sub-image of the current frame
+ * @param prev same sub-image of the previous frame
+ * @return uint64_t energy, 0 when there is no previous frame
+ */
+uint64_t MotionEnergy::compute(const uint8_t *cur, const uint8_t *prev) const{
+    if(cur == NULL || prev == NULL){
+        return 0;
+    }
+    uint64_t energy = 0;
+#ifdef MOTIONENERGY_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (size_t r = 0; r < height; r += rowStep)
+    {
+        const uint8_t *a = cur + r*pitch;
+        const uint8_t *b = prev + r*pitch;
+        for (size_t c = 0; c + 16 <= width; c += colStep)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + c));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + c));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb)); //two 64 bit partial sums, one per 8 bytes
+        }
+    }
+    uint64_t sums[2];
+    _mm_storeu_si128((__m128i *)sums, acc);
+    energy = sums[0] + sums[1];
+#else
+    for (size_t r = 0; r < height; r += rowStep)
+    {
+        const uint8_t *a = cur + r*pitch;
+        const uint8_t *b = prev + r*pitch;
+        for (size_t c = 0; c + 16 <= width; c += colStep)
+        {
+            for (size_t k = 0; k < 16; k++)
+            {
+                energy += (a[c+k] > b[c+k]) ? a[c+k] - b[c+k] : b[c+k] - a[c+k];
+            }
+        }
+    }
+#endif
+    return energy;
+}
+
+//tracks the pre-trigger baseline of the motion energy and the first frame after the trigger that rises above it
+class ReactionOnset{
+    public:
+        ReactionOnset(double threshold = 6.0, unsigned int minBaseline = 50);
+        ~ReactionOnset();
+        void add(uint64_t energy, uint64_t timeStamp, int index, bool trig);
+        bool found();
+        int64_t latency();
+        int onsetIndex;
+        uint64_t onsetTime;
+        uint64_t triggerTime;
+    private:
+        double threshold;
+        unsigned int minBaseline;
+        unsigned int count;
+        double mean;
+        double m2;
+        bool triggered;
+        bool detected;
+};
+/**
+ * @brief Construct a new ReactionOnset:: ReactionOnset object
+ *
+ * @param threshold1 number of baseline standard deviations above the baseline mean that counts as a reaction
+ * @param minBaseline1 pre-trigger frames needed before a reaction can be detected
+ */
+ReactionOnset::ReactionOnset(double threshold1, unsigned int minBaseline1){
+    threshold = threshold1;
+    minBaseline = minBaseline1;
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    triggered = false;
+    detected = false;
+    onsetIndex = -1;
+    onsetTime = 0;
+    triggerTime = 0;
+}
+ReactionOnset::~ReactionOnset(){
+
+}
+/**
+ * @brief feed the energy of one frame, in acquisition order
+ *
+ * @param energy motion energy of the frame
+ * @param timeStamp timestamp of the frame
+ * @param index frame index
+ * @param trig true for the frame on which the trigger was detected
+ */
+void ReactionOnset::add(uint64_t energy, uint64_t timeStamp, int index, bool trig){
+    if(trig){
+        triggered = true;
+        triggerTime = timeStamp;
+    }
+    if(!triggered){ //running mean and variance of the baseline (Welford)
+        ++count;
+        double delta = energy - mean;
+        mean += delta/count;
+        m2 += delta*(energy - mean);
+        return;
+    }
+    if(detected || count < minBaseline){
+        return;
+    }
+    double sd = std::sqrt(m2/(count - 1));
+    if(energy > mean + threshold*sd){
+        detected = true;
+        onsetIndex = index;
+        onsetTime = timeStamp;
+    }
+}
+bool ReactionOnset::found(){
+    return detected;
+}
+/**
+ * @brief time between the trigger and the reaction onset
+ *
+ * @return int64_t latency in timestamp units (microseconds), -1 if no onset was found
+ */
+int64_t ReactionOnset::latency(){
+    if(!detected){
+        return -1;
+    }
+    return (int64_t)(onsetTime - triggerTime);
+}
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file PartTuner.h
+ * @author Ori Garibi
+ * @brief multi-part buffers (BufferPartCount frames per buffer): timestamps of each part and the choice of the part count
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef PARTTUNER_H
+#define PARTTUNER_H
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include "ClockSync.h"
+
+//timestamps of the frames packed in one buffer, the buffer timestamp is taken when its last part lands
+class PartClock{
+    public:
+        PartClock(int parts, double fps);
+        void add(uint64_t bufferTs);
+        uint64_t partTime(int part);
+        double getPeriod();
+    private:
+        int parts;
+        double nominal; //frame period at the configured rate (us)
+        double period; //measured frame period (us)
+        uint64_t last; //previous buffer timestamp, 0 before the first
+        uint64_t current;
+};
+/**
+ * @brief Construct a new PartClock:: PartClock object
+ *
+ * @param parts1 frames per buffer
+ * @param fps configured frame rate
+ */
+PartClock::PartClock(int parts1, double fps){
+    parts = parts1;
+    nominal = 1e6/fps;
+    period = nominal;
+    last = 0;
+    current = 0;
+}
+//timestamp of the buffer just popped, consecutive buffers give the frame period
+void PartClock::add(uint64_t bufferTs){
+    if(last && bufferTs > last){
+        const double measured = (double)(bufferTs - last)/parts;
+        if(measured > nominal/2 && measured < nominal*2){ //a lost buffer or a pause would skew the period
+            period += (measured - period)/16;
+        }
+    }
+    last = bufferTs;
+    current = bufferTs;
+}
+//timestamp of part 0..parts-1 of the current buffer
+uint64_t PartClock::partTime(int part){
+    return current - (uint64_t)llround((parts - 1 - part)*period);
+}
+double PartClock::getPeriod(){
+    return period;
+}
+
+//picks BufferPartCount from the per-buffer cost measured in the previous trial
+class PartTuner{
+    public:
+        PartTuner(double fps, int maxParts, double overheadShare = 0.05);
+        void add(double overheadUs);
+        int choose(int current);
+        std::string report();
+    private:
+        double fps;
+        int maxParts;
+        double overheadShare;
+        RunningStats overhead;
+        double measured; //mean + sd of the last trial (us), reported after choose()
+        unsigned int buffers;
+        int chosen;
+};
+/**
+ * @brief Construct a new PartTuner:: PartTuner object
+ *
+ * @param fps1 frame rate
+ * @param maxParts1 upper bound, a trigger is only seen once per buffer so maxParts1/fps1 is the worst trigger delay
+ * @param overheadShare1 fraction of the frame period that per-buffer work may take
+ */
+PartTuner::PartTuner(double fps1, int maxParts1, double overheadShare1){
+    fps = fps1;
+    maxParts = maxParts1 > 0 ? maxParts1 : 1;
+    overheadShare = overheadShare1;
+    measured = 0;
+    buffers = 0;
+    chosen = 0;
+}
+//cost of one buffer that does not grow with its part count: getInfo, trigger check, queue sampling, requeue (us)
+void PartTuner::add(double overheadUs){
+    overhead.add(overheadUs);
+}
+/**
+ * @brief part count for the next trial, the smallest that keeps per-buffer work under overheadShare of the frame time
+ *
+ * @param current part count of the trial just measured
+ * @return int parts
+ */
+int PartTuner::choose(int current){
+    measured = overhead.getMean() + overhead.getStdDev(); //bursts matter more than the average
+    buffers = overhead.getCount();
+    overhead = RunningStats();
+    if(buffers < 100){ //too short to tell
+        chosen = current;
+        return current;
+    }
+    const double budget = overheadShare*1e6/fps; //per-frame allowance (us)
+    int parts = (int)std::ceil(measured/budget);
+    if(parts < 1){
+        parts = 1;
+    }
+    if(parts > maxParts){
+        parts = maxParts;
+    }
+    chosen = parts;
+    return parts;
+}
+std::string PartTuner::report(){
+    std::stringstream ss;
+    ss << "per-buffer overhead " << measured << " us (mean + sd of " << buffers << " buffers), part count " << chosen;
+    return ss.str();
+}
+#endif
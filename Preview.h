@@ -0,0 +1,145 @@
+/**
+ * @file Preview.h
+ * @author Ori Garibi
+ * @brief box-filtered low resolution preview written as one Y4M stream per trial
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef PREVIEW_H
+#define PREVIEW_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PREVIEW_SSE2
+#endif
+
+//downscales 8 bit frames by factor x factor while they are being stitched, rows are fed in order as they are written
+class Preview{
+    public:
+        Preview(const std::string &path, size_t width, size_t height, int factor, int fps);
+        ~Preview();
+        void beginFrame();
+        void addRows(const uint8_t *rows, size_t pitch, size_t n);
+        void endFrame();
+        unsigned int getFrameCount();
+    private:
+        void emitRow();
+        std::ofstream out;
+        size_t width;
+        size_t outWidth;
+        size_t outHeight;
+        int factor;
+        std::vector<uint16_t> acc; //vertical sums of the current band of factor lines
+        std::vector<uint8_t> frame; //downscaled frame
+        size_t accRows;
+        size_t outRow;
+        unsigned int frameCount;
+};
+/**
+ * @brief Construct a new Preview:: Preview object and write the Y4M header
+ *
+ * @param path output file, one per trial
+ * @param width1 pixels per line of the stitched frame
+ * @param height1 lines of the stitched frame
+ * @param factor1 downscale factor in both directions, 4 or 8
+ * @param fps frame rate written in the header
+ */
+Preview::Preview(const std::string &path, size_t width1, size_t height1, int factor1, int fps){
+    if(factor1 != 4 && factor1 != 8){
+        throw std::runtime_error("preview factor must be 4 or 8");
+    }
+    width = width1;
+    factor = factor1;
+    outWidth = width1/factor1;
+    outHeight = height1/factor1;
+    acc.assign(outWidth*factor1 + 16, 0); //padded so the vector loop never needs a tail
+    frame.assign(outWidth*outHeight, 0);
+    accRows = 0;
+    outRow = 0;
+    frameCount = 0;
+    out.open(path.c_str(), std::ios::binary);
+    if(!out){
+        throw std::runtime_error("could not open preview " + path);
+    }
+    out<<"YUV4MPEG2 W"<<outWidth<<" H"<<outHeight<<" F"<<fps<<":1 Ip A1:1 Cmono\n";
+}
+Preview::~Preview(){
+    out.close();
+}
+void Preview::beginFrame(){
+    accRows = 0;
+    outRow = 0;
+    memset(&acc[0], 0, acc.size()*sizeof(uint16_t));
+}
+/**
+ * @brief accumulate freshly stitched lines, called while they are still in cache
+ *
+ * @param rows first line
+ * @param pitch bytes between two lines
+ * @param n number of lines
+ */
+void Preview::addRows(const uint8_t *rows, size_t pitch, size_t n){
+    const size_t used = outWidth*factor;
+    for (size_t r = 0; r < n && outRow < outHeight; r++)
+    {
+        const uint8_t *src = rows + r*pitch;
+        uint16_t *a = &acc[0];
+        size_t x = 0;
+#ifdef PREVIEW_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= used; x += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            __m128i lo = _mm_loadu_si128((const __m128i *)(a + x));
+            __m128i hi = _mm_loadu_si128((const __m128i *)(a + x + 8));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            _mm_storeu_si128((__m128i *)(a + x), lo);
+            _mm_storeu_si128((__m128i *)(a + x + 8), hi);
+        }
+#endif
+        for (; x < used; x++)
+        {
+            a[x] += src[x];
+        }
+        if(++accRows == (size_t)factor){
+            emitRow();
+        }
+    }
+}
+//reduce the band horizontally and write one preview line
+void Preview::emitRow(){
+    uint8_t *dst = &frame[outRow*outWidth];
+    const uint16_t *a = &acc[0];
+    const unsigned int shift = (factor == 4) ? 4 : 6; //divide by factor*factor
+    for (size_t x = 0; x < outWidth; x++)
+    {
+        unsigned int sum = 0;
+        for (int k = 0; k < factor; k++)
+        {
+            sum += a[x*factor + k];
+        }
+        dst[x] = (uint8_t)(sum >> shift);
+    }
+    memset(&acc[0], 0, acc.size()*sizeof(uint16_t));
+    accRows = 0;
+    ++outRow;
+}
+void Preview::endFrame(){
+    out<<"FRAME\n";
+    out.write((const char *)&frame[0], frame.size());
+    ++frameCount;
+}
+unsigned int Preview::getFrameCount(){
+    return frameCount;
+}
+#endif
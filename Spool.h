@@ -0,0 +1,228 @@
+/**
+ * @file Spool.h
+ * @author Ori Garibi
+ * @brief preallocated ring file that holds acquired frames on disk so the capture can be longer than RAM
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef SPOOL_H
+#define SPOOL_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include "tools/tools.h"
+#include "FileWriter.h"
+#include "Trace.h"
+
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+//fixed ring of slots, slot i lives at offset i*slotSize; frames are copied to staging buffers and handed to a FileWriter
+class Spool{
+    public:
+        Spool(const std::string &path, size_t frameSize, unsigned int slotCount, FileWriter &writer, unsigned int stagingCount = 16);
+        ~Spool();
+        void store(unsigned int slot, uint8_t *const parts[], int numParts, size_t partSize);
+        void flush();
+        void read(unsigned int slot, uint8_t *dst);
+        double benchmark(uint64_t bytes);
+        uint8_t *allocSlot();
+        size_t getSlotSize();
+        unsigned int getSlotCount();
+        unsigned int getStalls();
+    private:
+        void readAt(uint8_t *buf, uint64_t offset);
+        std::string path;
+        size_t slotSize;
+        unsigned int slotCount;
+        FileWriter &writer;
+        int file;
+        std::vector<uint8_t *> staging;
+        std::vector<uint8_t *> freeBufs;
+        std::mutex lock;
+        std::condition_variable cond;
+        unsigned int stalls;
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+        int fd; //read handle, opened on the first read
+#else
+        HANDLE fd;
+#endif
+};
+/**
+ * @brief Construct a new Spool:: Spool object, create and preallocate the ring file
+ *
+ * @param path1 spool file, should be on the fastest local disk
+ * @param frameSize bytes of one frame from all grabbers
+ * @param slotCount1 number of frames the ring holds
+ * @param writer1 backend that performs the writes
+ * @param stagingCount number of frames that can wait in RAM for the disk
+ */
+Spool::Spool(const std::string &path1, size_t frameSize, unsigned int slotCount1, FileWriter &writer1, unsigned int stagingCount) : writer(writer1){
+    path = path1;
+    slotSize = alignUp(frameSize);
+    slotCount = slotCount1;
+    stalls = 0;
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    fd = -1;
+#else
+    fd = INVALID_HANDLE_VALUE;
+#endif
+    file = writer.open(path, (uint64_t)slotSize*slotCount, true, false); //the extent of the last trial is reused, stale slots are never read
+    for (unsigned int i = 0; i < stagingCount; i++)
+    {
+        staging.push_back(alignedAlloc(slotSize));
+        freeBufs.push_back(staging.back());
+    }
+}
+Spool::~Spool(){
+    writer.close(file, (uint64_t)slotSize*slotCount); //keep the allocation for the next trial
+    for (size_t i = 0; i < staging.size(); i++)
+    {
+        alignedFree(staging[i]);
+    }
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if(fd >= 0){
+        close(fd);
+    }
+#else
+    if(fd != INVALID_HANDLE_VALUE){
+        CloseHandle(fd);
+    }
+#endif
+}
+/**
+ * @brief copy one frame out of the grabber buffers and queue it for the disk, the grabber buffers can be requeued on return
+ *
+ * @param slot ring slot, the caller owns the slot numbering
+ * @param parts sub-image of each grabber
+ * @param numParts number of grabbers
+ * @param partSize bytes per sub-image
+ */
+void Spool::store(unsigned int slot, uint8_t *const parts[], int numParts, size_t partSize){
+    uint8_t *buf;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if(freeBufs.empty()){ //disk is behind, acquisition waits
+            ++stalls;
+            TraceSpan span("spool stall", "acquire", "slot", slot);
+            cond.wait(guard, [this]{ return !freeBufs.empty(); });
+        }
+        buf = freeBufs.back();
+        freeBufs.pop_back();
+    }
+    for (int i = 0; i < numParts; i++)
+    {
+        memcpy(buf + i*partSize, parts[i], partSize);
+    }
+    writer.write(file, buf, slotSize, (uint64_t)(slot % slotCount)*slotSize, [this, buf]{
+        std::unique_lock<std::mutex> guard(lock);
+        freeBufs.push_back(buf); //only recycled once the write has landed
+        cond.notify_all();
+    });
+}
+//wait until every queued frame is on disk
+void Spool::flush(){
+    writer.wait(file);
+}
+/**
+ * @brief read a frame back, call flush() first
+ *
+ * @param slot ring slot
+ * @param dst buffer from allocSlot()
+ */
+void Spool::read(unsigned int slot, uint8_t *dst){
+    readAt(dst, (uint64_t)(slot % slotCount)*slotSize);
+}
+/**
+ * @brief sustained write throughput of the spool disk through the writer backend, every write is queued at once so the backend runs at its full depth
+ *
+ * @param bytes written at least, cycling over the ring; several times the device write cache or the cache hides the disk
+ * @return double bytes per second
+ */
+double Spool::benchmark(uint64_t bytes){
+    const uint64_t count = (bytes + slotSize - 1)/slotSize;
+    uint8_t *buf = allocSlot();
+    memset(buf, 0, slotSize);
+    uint64_t start = Tools::getTimestamp();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        writer.write(file, buf, slotSize, (i % slotCount)*slotSize, WriteDone());
+    }
+    writer.wait(file);
+    uint64_t elapsed = Tools::getTimestamp() - start;
+    alignedFree(buf);
+    if(elapsed == 0){
+        elapsed = 1;
+    }
+    return (double)slotSize*count*1e6/elapsed;
+}
+uint8_t *Spool::allocSlot(){
+    return alignedAlloc(slotSize);
+}
+size_t Spool::getSlotSize(){
+    return slotSize;
+}
+unsigned int Spool::getSlotCount(){
+    return slotCount;
+}
+unsigned int Spool::getStalls(){
+    std::unique_lock<std::mutex> guard(lock);
+    return stalls;
+}
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+void Spool::readAt(uint8_t *buf, uint64_t offset){
+    if(fd < 0){
+        int flags = O_RDONLY;
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#endif
+        fd = open(path.c_str(), flags);
+        if(fd < 0){
+            throw std::runtime_error("could not open spool " + path);
+        }
+    }
+    size_t done = 0;
+    while(done < slotSize){
+        ssize_t n = pread(fd, buf + done, slotSize - done, offset + done);
+        if(n <= 0){
+            throw std::runtime_error("spool read failed on " + path);
+        }
+        done += n;
+    }
+}
+#else
+void Spool::readAt(uint8_t *buf, uint64_t offset){
+    if(fd == INVALID_HANDLE_VALUE){
+        fd = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL);
+        if(fd == INVALID_HANDLE_VALUE){
+            throw std::runtime_error("could not open spool " + path);
+        }
+    }
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD n = 0;
+    if(!ReadFile(fd, buf, (DWORD)slotSize, &n, &ov) || n != slotSize){
+        throw std::runtime_error("spool read failed on " + path);
+    }
+}
+#endif
+#endif
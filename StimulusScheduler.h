@@ -0,0 +1,335 @@
+/**
+ * @file StimulusScheduler.h
+ * @author Ori Garibi
+ * @brief timed camera and stimulus commands: absolute deadline sleep plus a short spin on a dedicated thread, with the lateness of every fire
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef STIMULUSSCHEDULER_H
+#define STIMULUSSCHEDULER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "tools/tools.h"
+#include "ClockSync.h"
+#include "Trace.h"
+
+#if defined(linux) || defined(__linux) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#define STIMULUS_POSIX
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#else
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 //Windows 10 1803 and later
+#endif
+#endif
+
+static const uint64_t STIMULUS_SLICE = 10000000; //longest single sleep (ns), a stop request is seen within it
+
+//waits for the coarse part of a deadline, the caller spins the rest
+class DeadlineTimer{
+    public:
+        DeadlineTimer();
+        ~DeadlineTimer();
+        void sleepUntil(uint64_t deadline);
+        uint64_t getSlack();
+    private:
+        uint64_t slack; //ns before the deadline where sleeping stops and spinning starts
+#ifndef STIMULUS_POSIX
+        HANDLE timer;
+#endif
+};
+DeadlineTimer::DeadlineTimer(){
+#ifdef STIMULUS_POSIX
+    slack = 200000; //clock_nanosleep wakes up within tens of us on an idle core
+#else
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    slack = 500000;
+    if(timer == NULL){ //older Windows, the timer follows the 1 to 15.6 ms system tick
+        timer = CreateWaitableTimer(NULL, TRUE, NULL);
+        slack = 16000000;
+    }
+    if(timer == NULL){
+        throw std::runtime_error("could not create a waitable timer");
+    }
+#endif
+}
+DeadlineTimer::~DeadlineTimer(){
+#ifndef STIMULUS_POSIX
+    CloseHandle(timer);
+#endif
+}
+/**
+ * @brief sleep until at most the slack before the deadline, or one slice
+ *
+ * @param deadline Tools::getTimestampNs() of the fire
+ */
+void DeadlineTimer::sleepUntil(uint64_t deadline){
+    const uint64_t now = Tools::getTimestampNs();
+    if(deadline <= now + slack){
+        return;
+    }
+    uint64_t wait = deadline - slack - now;
+    if(wait > STIMULUS_SLICE){
+        wait = STIMULUS_SLICE;
+    }
+#ifdef STIMULUS_POSIX
+    //getTimestampNs() is CLOCK_MONOTONIC_RAW, which clock_nanosleep does not take; the two differ by ppm over one slice
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t target = (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec + wait;
+    ts.tv_sec = target/1000000000;
+    ts.tv_nsec = target%1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR){ //absolute, so a signal does not stretch the sleep
+    }
+#else
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)(wait/100); //relative, in 100 ns units
+    if(SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)){
+        WaitForSingleObject(timer, INFINITE);
+    }
+#endif
+}
+uint64_t DeadlineTimer::getSlack(){
+    return slack;
+}
+//sleep then spin to a Tools::getTimestampNs() deadline, for callers without a scheduler (trial pacing)
+inline void sleepUntilNs(uint64_t deadline){
+    DeadlineTimer timer;
+    while(Tools::getTimestampNs() + timer.getSlack() < deadline){
+        timer.sleepUntil(deadline);
+    }
+    while(Tools::getTimestampNs() < deadline){
+    }
+}
+
+//one timed command and what happened when it ran
+struct StimulusEvent{
+    std::string name;
+    uint64_t at; //ns after the origin given to start()
+    std::function<void()> action;
+    uint64_t deadline; //Tools::getTimestampNs()
+    uint64_t fired; //when the command was issued, 0 when it never ran
+    uint64_t done; //when the command returned
+    std::string error;
+    bool cleanup; //run by stop() when the timeline ends before it, e.g. the stimulus off
+    bool atStop; //ran from stop() instead of at its deadline
+};
+//fire time handed to the acquisition loop
+struct StimulusFire{
+    std::string name;
+    uint64_t hostTime; //us, Tools::getTimestamp() clock
+};
+
+//runs the commands of a trial at their deadlines on its own high priority thread
+class StimulusScheduler{
+    public:
+        StimulusScheduler();
+        ~StimulusScheduler();
+        void add(const std::string &name, uint64_t atUs, std::function<void()> action, bool logged = true);
+        void addCleanup(const std::string &name, uint64_t atUs, std::function<void()> action);
+        void start(uint64_t origin);
+        void stop();
+        bool takeFired(StimulusFire &fire);
+        std::string report();
+        void save(const std::string &path);
+        RunningStats lateness; //fired minus deadline (us)
+        RunningStats command; //time taken by the commands (us)
+    private:
+        StimulusEvent &insert(const std::string &name, uint64_t atUs, std::function<void()> action, bool logged);
+        void run();
+        std::vector<StimulusEvent> events;
+        std::vector<bool> loggedEvents; //events passed to takeFired()
+        std::deque<StimulusFire> fired;
+        std::thread worker;
+        std::atomic<bool> quit;
+        std::mutex lock;
+};
+StimulusScheduler::StimulusScheduler(){
+    quit = false;
+}
+StimulusScheduler::~StimulusScheduler(){
+    stop();
+}
+/**
+ * @brief add a command to the timeline, before start()
+ *
+ * @param name label in the logs and the CSV, a string literal
+ * @param atUs offset from the origin (us)
+ * @param action the command, kept short: its duration delays the next events
+ * @param logged hand the fire time to takeFired() so it reaches the frame records
+ */
+void StimulusScheduler::add(const std::string &name, uint64_t atUs, std::function<void()> action, bool logged){
+    insert(name, atUs, action, logged);
+}
+/**
+ * @brief add a command that must run even when the timeline is cut: stop() runs it if it has not run without error
+ *
+ * @param name label in the logs and the CSV, a string literal
+ * @param atUs offset from the origin (us)
+ * @param action the command, also called from the thread that calls stop()
+ */
+void StimulusScheduler::addCleanup(const std::string &name, uint64_t atUs, std::function<void()> action){
+    insert(name, atUs, action, false).cleanup = true;
+}
+//place an event in time order
+StimulusEvent &StimulusScheduler::insert(const std::string &name, uint64_t atUs, std::function<void()> action, bool logged){
+    if(worker.joinable()){
+        throw std::runtime_error("stimulus scheduler already started");
+    }
+    StimulusEvent e;
+    e.name = name;
+    e.at = atUs*1000;
+    e.action = action;
+    e.deadline = 0;
+    e.fired = 0;
+    e.done = 0;
+    e.cleanup = false;
+    e.atStop = false;
+    size_t i = events.size();
+    while(i > 0 && events[i - 1].at > e.at){ //kept in time order
+        --i;
+    }
+    events.insert(events.begin() + i, e);
+    loggedEvents.insert(loggedEvents.begin() + i, logged);
+    return events[i];
+}
+/**
+ * @brief start the timeline
+ *
+ * @param origin Tools::getTimestampNs() the offsets are counted from
+ */
+void StimulusScheduler::start(uint64_t origin){
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        events[i].deadline = origin + events[i].at;
+    }
+    quit = false;
+    worker = std::thread(&StimulusScheduler::run, this);
+}
+//cancel what has not fired, wait for the thread, then run the cleanup commands that have not run or failed
+void StimulusScheduler::stop(){
+    quit = true;
+    if(worker.joinable()){
+        worker.join();
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        StimulusEvent &e = events[i];
+        if(!e.cleanup || !e.deadline || e.atStop || (e.fired && e.error.empty())){
+            continue;
+        }
+        e.atStop = true;
+        e.fired = Tools::getTimestampNs();
+        e.error.clear();
+        try {
+            e.action();
+        }
+        catch (const std::exception &ex) {
+            e.error = ex.what();
+        }
+        catch (...) { //stop() also runs from the destructor while an exception unwinds
+            e.error = "unknown error";
+        }
+        e.done = Tools::getTimestampNs();
+    }
+}
+void StimulusScheduler::run(){
+    Trace::instance().nameThread("stimulus scheduler");
+#ifdef STIMULUS_POSIX
+    struct sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param); //needs CAP_SYS_NICE, the spin still keeps jitter low without it
+#else
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+    DeadlineTimer timer;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        StimulusEvent &e = events[i];
+        while(!quit && Tools::getTimestampNs() + timer.getSlack() < e.deadline){
+            timer.sleepUntil(e.deadline);
+        }
+        if(quit){
+            return;
+        }
+        while(Tools::getTimestampNs() < e.deadline){ //last stretch, the sleep wake-up is too coarse for it
+        }
+        e.fired = Tools::getTimestampNs();
+        try {
+            e.action();
+        }
+        catch (const std::exception &ex) {
+            e.error = ex.what();
+        }
+        e.done = Tools::getTimestampNs();
+        Trace::instance().complete("stimulus", "stimulus", e.fired, e.done, "event", i, "late ns", e.fired - e.deadline);
+        std::unique_lock<std::mutex> guard(lock);
+        lateness.add((e.fired - e.deadline)/1000.0);
+        command.add((e.done - e.fired)/1000.0);
+        if(loggedEvents[i] && e.error.empty()){
+            StimulusFire f;
+            f.name = e.name;
+            f.hostTime = e.fired/1000;
+            fired.push_back(f);
+        }
+    }
+}
+/**
+ * @brief next fire not taken yet, polled by the acquisition loop
+ *
+ * @param fire filled when there is one
+ * @return true a fire was taken
+ */
+bool StimulusScheduler::takeFired(StimulusFire &fire){
+    std::unique_lock<std::mutex> guard(lock);
+    if(fired.empty()){
+        return false;
+    }
+    fire = fired.front();
+    fired.pop_front();
+    return true;
+}
+std::string StimulusScheduler::report(){
+    std::unique_lock<std::mutex> guard(lock);
+    std::stringstream ss;
+    ss << lateness.getCount() << " of " << events.size() << " stimulus events fired, lateness mean " << lateness.getMean() << " us, sd " << lateness.getStdDev()
+       << " us, max " << lateness.getMax() << " us, command mean " << command.getMean() << " us, max " << command.getMax() << " us";
+    return ss.str();
+}
+//one row per event: what was planned, when it ran, how late and how long the command took
+void StimulusScheduler::save(const std::string &path){
+    std::unique_lock<std::mutex> guard(lock);
+    std::ofstream out(path.c_str());
+    out << "Event,Deadline(in microseconds),Fired(in microseconds),Late(in nanoseconds),Command(in nanoseconds),Error\n";
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const StimulusEvent &e = events[i];
+        out << e.name << "," << e.deadline/1000 << ",";
+        if(e.fired){
+            out << e.fired/1000 << "," << (int64_t)(e.fired - e.deadline) << "," << e.done - e.fired << "," << (e.atStop ? (e.error.empty() ? "run at stop" : "run at stop: " + e.error) : e.error) << "\n"; //early when run at stop
+        }
+        else{
+            out << ",,,not fired\n";
+        }
+    }
+    if(!out){
+        throw std::runtime_error("could not write " + path);
+    }
+}
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file StreamMonitor.h
+ * @author Ori Garibi
+ * @brief periodic sampling of the grabber stream queues and the policy applied when they get close to overrun
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef STREAMMONITOR_H
+#define STREAMMONITOR_H
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <D:\Euresys\eGrabber\include\EGrabber.h>
+
+//what to do when a queue gets close to overrun, flags can be combined
+enum OverrunPolicy {
+    OVERRUN_IGNORE = 0,
+    OVERRUN_QUIET_LOG = 1 << 0,      //stop per-frame console output
+    OVERRUN_PAUSE_ANALYSIS = 1 << 1, //skip motion energy and other optional per-frame work
+    OVERRUN_ABORT = 1 << 2           //stop the trial at the abort level or on the first lost frame
+};
+
+//last sampled GenTL stream counters of one grabber
+struct StreamCounters{
+    uint64_t announced;
+    uint64_t queued;
+    uint64_t awaitDelivery; //filled buffers the loop has not popped yet, the output queue depth
+    uint64_t delivered;
+    uint64_t lost; //STREAM_INFO_NUM_UNDERRUN, frames dropped for lack of a free buffer
+};
+
+class StreamMonitor{
+    public:
+        StreamMonitor(int numGrabbers, unsigned int policy, unsigned int sampleEvery = 50, double warnLevel = 0.5, double abortLevel = 0.9);
+        template <class G> void start(std::vector<G *> &grabbers);
+        template <class G> bool sample(unsigned int frame, std::vector<G *> &grabbers);
+        bool quietLogging();
+        bool pauseAnalysis();
+        bool aborted();
+        const std::string &getAbortReason();
+        const StreamCounters &getCounters(int grabber);
+        std::string live();
+        std::string report();
+    private:
+        template <class G> void read(G *grabber, StreamCounters &c);
+        unsigned int policy;
+        unsigned int sampleEvery;
+        double warnLevel;
+        double abortLevel;
+        bool pressured;
+        bool abort;
+        std::string abortReason;
+        std::vector<StreamCounters> counters;
+        std::vector<StreamCounters> first; //counters at trial start, lost frames are counted from there
+        std::vector<double> maxFill;
+        std::vector<double> sumFill;
+        unsigned int samples;
+        unsigned int pressuredSamples;
+};
+/**
+ * @brief Construct a new StreamMonitor:: StreamMonitor object
+ *
+ * @param numGrabbers grabbers to watch
+ * @param policy1 OverrunPolicy flags
+ * @param sampleEvery1 frames between two samples, the counters are GenTL calls and too slow for every frame
+ * @param warnLevel1 output queue fill (awaiting delivery / announced) where the policy kicks in
+ * @param abortLevel1 output queue fill where OVERRUN_ABORT stops the trial
+ */
+StreamMonitor::StreamMonitor(int numGrabbers, unsigned int policy1, unsigned int sampleEvery1, double warnLevel1, double abortLevel1){
+    policy = policy1;
+    sampleEvery = sampleEvery1 ? sampleEvery1 : 1;
+    warnLevel = warnLevel1;
+    abortLevel = abortLevel1;
+    pressured = false;
+    abort = false;
+    counters.assign(numGrabbers, StreamCounters());
+    first.assign(numGrabbers, StreamCounters());
+    maxFill.assign(numGrabbers, 0);
+    sumFill.assign(numGrabbers, 0);
+    samples = 0;
+    pressuredSamples = 0;
+}
+//GenTL stream counters of one grabber
+template <class G> void StreamMonitor::read(G *grabber, StreamCounters &c){
+    c.announced = grabber->template getInfo<Euresys::StreamModule, uint64_t>(Euresys::gc::STREAM_INFO_NUM_ANNOUNCED);
+    c.queued = grabber->template getInfo<Euresys::StreamModule, uint64_t>(Euresys::gc::STREAM_INFO_NUM_QUEUED);
+    c.awaitDelivery = grabber->template getInfo<Euresys::StreamModule, uint64_t>(Euresys::gc::STREAM_INFO_NUM_AWAIT_DELIVERY);
+    c.delivered = grabber->template getInfo<Euresys::StreamModule, uint64_t>(Euresys::gc::STREAM_INFO_NUM_DELIVERED);
+    c.lost = grabber->template getInfo<Euresys::StreamModule, uint64_t>(Euresys::gc::STREAM_INFO_NUM_UNDERRUN);
+}
+/**
+ * @brief take the baseline of the counters, before the first buffer is popped
+ *
+ * @param grabbers grabbers of the camera, started
+ */
+template <class G> void StreamMonitor::start(std::vector<G *> &grabbers){
+    for (size_t i = 0; i < grabbers.size(); i++)
+    {
+        read(grabbers[i], first[i]);
+        counters[i] = first[i];
+    }
+}
+/**
+ * @brief read the stream counters every sampleEvery frames and update the pressure state
+ *
+ * @param frame frame counter of the acquisition loop
+ * @param grabbers grabbers of the camera
+ * @return true when a sample was taken
+ */
+template <class G> bool StreamMonitor::sample(unsigned int frame, std::vector<G *> &grabbers){
+    if(frame % sampleEvery != 0){
+        return false;
+    }
+    bool high = false;
+    for (size_t i = 0; i < grabbers.size(); i++)
+    {
+        StreamCounters &c = counters[i];
+        read(grabbers[i], c);
+        double fill = c.announced ? (double)c.awaitDelivery/c.announced : 0;
+        sumFill[i] += fill;
+        if(fill > maxFill[i]){
+            maxFill[i] = fill;
+        }
+        const uint64_t lost = c.lost - first[i].lost;
+        if(fill >= warnLevel || lost){
+            high = true;
+        }
+        if((policy & OVERRUN_ABORT) && !abort && (fill >= abortLevel || lost)){
+            std::stringstream ss;
+            ss << "grabber " << i << " output queue at " << (int)(fill*100) << "% (" << c.awaitDelivery << " of " << c.announced
+               << " buffers), " << lost << " frames lost at frame " << frame;
+            abort = true;
+            abortReason = ss.str();
+        }
+    }
+    pressured = high;
+    ++samples;
+    if(high){
+        ++pressuredSamples;
+    }
+    return true;
+}
+bool StreamMonitor::quietLogging(){
+    return pressured && (policy & OVERRUN_QUIET_LOG);
+}
+bool StreamMonitor::pauseAnalysis(){
+    return pressured && (policy & OVERRUN_PAUSE_ANALYSIS);
+}
+bool StreamMonitor::aborted(){
+    return abort;
+}
+const std::string &StreamMonitor::getAbortReason(){
+    return abortReason;
+}
+const StreamCounters &StreamMonitor::getCounters(int grabber){
+    return counters[grabber];
+}
+//counters of the last sample on one line, printed while the trial runs
+std::string StreamMonitor::live(){
+    std::stringstream ss;
+    ss << "queues";
+    for (size_t i = 0; i < counters.size(); i++)
+    {
+        ss << " | grabber " << i << ": " << counters[i].awaitDelivery << "/" << counters[i].announced << " awaiting, " << counters[i].queued
+           << " queued, delivered " << counters[i].delivered - first[i].delivered << ", lost " << counters[i].lost - first[i].lost;
+    }
+    return ss.str();
+}
+//end of trial summary, one line per grabber
+std::string StreamMonitor::report(){
+    std::stringstream ss;
+    for (size_t i = 0; i < counters.size() && samples; i++)
+    {
+        ss << "grabber " << i << ": queue fill max " << (int)(maxFill[i]*100) << "%, mean " << (int)(sumFill[i]/samples*100)
+           << "%, delivered " << counters[i].delivered - first[i].delivered << ", lost " << counters[i].lost - first[i].lost << "\n";
+    }
+    ss << "under pressure in " << pressuredSamples << " of " << samples << " samples";
+    return ss.str();
+}
+#endif
@@ -0,0 +1,92 @@
+/**
+ * @file Topology.h
+ * @author Ori Garibi
+ * @brief description of the cameras, the grabbers behind each camera and how their stripes are stitched
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+//where a grabber lives in the GenTL tree
+struct GrabberLocation{
+    int interfaceIndex;
+    int deviceIndex;
+};
+
+//one camera and its grabbers; grabbers are listed in stripe order
+struct CameraTopology{
+    std::string name; //output sub-directory of the trial, empty to write straight into the trial directory
+    std::vector<GrabberLocation> grabbers;
+    int master; //index in grabbers of the grabber that controls the camera and sees the trigger line
+    std::string stripeArrangement;
+    int lineWidth;
+    int linePitch;
+    int stripeHeight;
+    int stripePitch;
+    int blockHeight;
+    int stripeOffset;
+    int stripeLines; //consecutive lines of the stitched frame that come from one grabber
+    bool mirrored; //top half stacks the grabbers in reverse order (Geometry_1X_2YM)
+};
+
+/**
+ * @brief add a grabber to a camera
+ *
+ * @param camera camera to extend
+ * @param interfaceIndex GenTL interface (board)
+ * @param deviceIndex GenTL device on that interface
+ */
+inline void addGrabber(CameraTopology &camera, int interfaceIndex, int deviceIndex){
+    GrabberLocation location;
+    location.interfaceIndex = interfaceIndex;
+    location.deviceIndex = deviceIndex;
+    camera.grabbers.push_back(location);
+}
+
+/**
+ * @brief Phantom S640 on two Coaxlink boards, four grabbers, stripes 1X_2YM
+ *
+ * @param name output sub-directory, empty for the single camera rig
+ * @param firstInterface interface index of the first of the two boards
+ * @return CameraTopology
+ */
+inline CameraTopology phantomS640(const std::string &name, int firstInterface){
+    CameraTopology camera;
+    camera.name = name;
+    for (int id = 0; id < 4; id++)
+    {
+        addGrabber(camera, firstInterface + id/2, id%2);
+    }
+    camera.master = 0;
+    camera.stripeArrangement = "Geometry_1X_2YM";
+    camera.lineWidth = 2560;
+    camera.linePitch = 2560;
+    camera.stripeHeight = 4;
+    camera.stripePitch = 4;
+    camera.blockHeight = 4;
+    camera.stripeOffset = 0;
+    camera.stripeLines = 2;
+    camera.mirrored = true;
+    return camera;
+}
+
+//throws when a description cannot be acquired or stitched
+inline void checkTopology(const CameraTopology &camera){
+    if(camera.grabbers.empty()){
+        throw std::runtime_error("camera " + camera.name + " has no grabber");
+    }
+    if(camera.master < 0 || camera.master >= (int)camera.grabbers.size()){
+        throw std::runtime_error("camera " + camera.name + " has no valid master grabber");
+    }
+    if(camera.stripeLines <= 0){
+        throw std::runtime_error("camera " + camera.name + " has no stripe lines");
+    }
+}
+#endif
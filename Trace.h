@@ -0,0 +1,296 @@
+/**
+ * @file Trace.h
+ * @author Ori Garibi
+ * @brief timeline of the acquisition and save pipeline, per-thread lock-free event buffers dumped as Chrome trace JSON
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TRACE_H
+#define TRACE_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "tools/tools.h"
+
+//one complete span ('X') or instant ('i'); names are string literals so recording never allocates
+struct TraceEvent{
+    const char *name;
+    const char *category;
+    char phase;
+    uint64_t start; //host ns, Tools::getTimestampNs()
+    uint64_t duration;
+    const char *argName1; //NULL when unused
+    int64_t arg1;
+    const char *argName2;
+    int64_t arg2;
+};
+
+//events of one thread; only the owner appends, the count is published so a dump sees complete events
+struct TraceBuffer{
+    std::vector<TraceEvent> events;
+    std::atomic<size_t> count;
+    std::atomic<bool> alive;
+    uint64_t dropped; //events lost because the buffer was full
+    uint32_t tid;
+    std::string name;
+};
+
+//thread names come from camera names, keep them valid JSON
+inline std::string traceEscape(const std::string &text){
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if(text[i] == '"' || text[i] == '\\'){
+            out += '\\';
+        }
+        if((unsigned char)text[i] >= 0x20){
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+//process wide, every pipeline thread records into its own buffer
+class Trace{
+    public:
+        static Trace &instance();
+        void setEnabled(bool on, size_t eventsPerThread = 1 << 17);
+        bool isEnabled();
+        void nameThread(const std::string &name);
+        void complete(const char *name, const char *category, uint64_t start, uint64_t end,
+                      const char *argName1 = NULL, int64_t arg1 = 0, const char *argName2 = NULL, int64_t arg2 = 0);
+        void instant(const char *name, const char *category, const char *argName1 = NULL, int64_t arg1 = 0, const char *argName2 = NULL, int64_t arg2 = 0);
+        void dump(const std::string &path);
+        void clear();
+    private:
+        Trace();
+        TraceBuffer *buffer();
+        void record(const TraceEvent &e);
+        std::atomic<bool> enabled;
+        size_t capacity;
+        uint32_t nextTid;
+        uint64_t origin; //ns subtracted from every timestamp so the JSON numbers stay short
+        std::mutex lock; //registry only, never taken while recording
+        std::vector<std::unique_ptr<TraceBuffer> > buffers;
+};
+
+//marks the buffer of a thread that exited, clear() then frees it
+struct TraceThread{
+    TraceBuffer *buf;
+    TraceThread() : buf(NULL) {}
+    ~TraceThread(){
+        if(buf){
+            buf->alive = false;
+        }
+    }
+};
+thread_local TraceThread traceThread;
+
+Trace::Trace(){
+    enabled = false;
+    capacity = 0;
+    nextTid = 1;
+    origin = Tools::getTimestampNs();
+}
+Trace &Trace::instance(){
+    static Trace trace;
+    return trace;
+}
+/**
+ * @brief turn recording on or off
+ *
+ * @param on record events
+ * @param eventsPerThread size of each thread buffer, later events of a full buffer are dropped and counted
+ */
+void Trace::setEnabled(bool on, size_t eventsPerThread){
+    std::unique_lock<std::mutex> guard(lock);
+    capacity = eventsPerThread;
+    enabled = on;
+}
+bool Trace::isEnabled(){
+    return enabled.load(std::memory_order_relaxed);
+}
+//buffer of the calling thread, registered on first use
+TraceBuffer *Trace::buffer(){
+    if(traceThread.buf == NULL){
+        std::unique_ptr<TraceBuffer> b(new TraceBuffer());
+        std::unique_lock<std::mutex> guard(lock);
+        b->events.resize(capacity);
+        b->count = 0;
+        b->alive = true;
+        b->dropped = 0;
+        b->tid = nextTid++;
+        b->name = "thread " + std::to_string(b->tid);
+        traceThread.buf = b.get();
+        buffers.push_back(std::move(b));
+    }
+    return traceThread.buf;
+}
+//label shown for the calling thread in the viewer
+void Trace::nameThread(const std::string &name){
+    if(!isEnabled()){
+        return;
+    }
+    TraceBuffer *b = buffer();
+    std::unique_lock<std::mutex> guard(lock);
+    b->name = name;
+}
+void Trace::record(const TraceEvent &e){
+    TraceBuffer *b = buffer();
+    const size_t n = b->count.load(std::memory_order_relaxed);
+    if(n >= b->events.size()){
+        ++b->dropped;
+        return;
+    }
+    b->events[n] = e;
+    b->count.store(n + 1, std::memory_order_release);
+}
+/**
+ * @brief record a span that has ended
+ *
+ * @param name span name, a string literal
+ * @param category acquire, save, encode, write...
+ * @param start Tools::getTimestampNs() at the beginning
+ * @param end Tools::getTimestampNs() at the end
+ * @param argName1 name of an integer argument (frame, grabber, bytes), NULL for none
+ */
+void Trace::complete(const char *name, const char *category, uint64_t start, uint64_t end,
+                     const char *argName1, int64_t arg1, const char *argName2, int64_t arg2){
+    if(!isEnabled()){
+        return;
+    }
+    TraceEvent e;
+    e.name = name;
+    e.category = category;
+    e.phase = 'X';
+    e.start = start;
+    e.duration = end > start ? end - start : 0;
+    e.argName1 = argName1;
+    e.arg1 = arg1;
+    e.argName2 = argName2;
+    e.arg2 = arg2;
+    record(e);
+}
+void Trace::instant(const char *name, const char *category, const char *argName1, int64_t arg1, const char *argName2, int64_t arg2){
+    if(!isEnabled()){
+        return;
+    }
+    TraceEvent e;
+    e.name = name;
+    e.category = category;
+    e.phase = 'i';
+    e.start = Tools::getTimestampNs();
+    e.duration = 0;
+    e.argName1 = argName1;
+    e.arg1 = arg1;
+    e.argName2 = argName2;
+    e.arg2 = arg2;
+    record(e);
+}
+/**
+ * @brief write every recorded event as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+ *
+ * @param path JSON file
+ */
+void Trace::dump(const std::string &path){
+    std::ofstream out(path.c_str());
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    std::unique_lock<std::mutex> guard(lock);
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        TraceBuffer &b = *buffers[i];
+        const size_t n = b.count.load(std::memory_order_acquire);
+        out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << b.tid << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << traceEscape(b.name) << "\"}}";
+        first = false;
+        if(b.dropped){
+            out << ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << b.tid << ",\"ts\":0,\"name\":\"trace buffer full\",\"args\":{\"dropped\":" << b.dropped << "}}";
+        }
+        for (size_t k = 0; k < n; k++)
+        {
+            const TraceEvent &e = b.events[k];
+            const uint64_t ts = e.start > origin ? e.start - origin : 0; //events from before the last clear() start at 0
+            out << ",\n{\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << b.tid << ",\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+                << "\",\"ts\":" << ts/1000 << "." << std::setw(3) << std::setfill('0') << ts%1000 << std::setw(0);
+            if(e.phase == 'X'){
+                out << ",\"dur\":" << e.duration/1000 << "." << std::setw(3) << std::setfill('0') << e.duration%1000 << std::setw(0);
+            }
+            else{
+                out << ",\"s\":\"t\"";
+            }
+            if(e.argName1){
+                out << ",\"args\":{\"" << e.argName1 << "\":" << e.arg1;
+                if(e.argName2){
+                    out << ",\"" << e.argName2 << "\":" << e.arg2;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    if(!out){
+        throw std::runtime_error("could not write trace " + path);
+    }
+}
+//forget recorded events and the buffers of threads that have exited; no pipeline may be running
+void Trace::clear(){
+    std::unique_lock<std::mutex> guard(lock);
+    std::vector<std::unique_ptr<TraceBuffer> > kept;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        if(buffers[i]->alive){
+            buffers[i]->count = 0;
+            buffers[i]->dropped = 0;
+            kept.push_back(std::move(buffers[i]));
+        }
+    }
+    buffers.swap(kept);
+    origin = Tools::getTimestampNs();
+}
+
+//times the enclosing scope and records it as one span
+class TraceSpan{
+    public:
+        TraceSpan(const char *name, const char *category, const char *argName1 = NULL, int64_t arg1 = 0, const char *argName2 = NULL, int64_t arg2 = 0);
+        ~TraceSpan();
+        void end();
+    private:
+        const char *name;
+        const char *category;
+        const char *argName1;
+        int64_t arg1;
+        const char *argName2;
+        int64_t arg2;
+        uint64_t start; //0 when tracing is off or the span has ended
+};
+TraceSpan::TraceSpan(const char *name1, const char *category1, const char *argName11, int64_t arg11, const char *argName21, int64_t arg21){
+    name = name1;
+    category = category1;
+    argName1 = argName11;
+    arg1 = arg11;
+    argName2 = argName21;
+    arg2 = arg21;
+    start = Trace::instance().isEnabled() ? Tools::getTimestampNs() : 0;
+}
+TraceSpan::~TraceSpan(){
+    end();
+}
+//close the span before the end of the scope
+void TraceSpan::end(){
+    if(start){
+        Trace::instance().complete(name, category, start, Tools::getTimestampNs(), argName1, arg1, argName2, arg2);
+        start = 0;
+    }
+}
+#endif
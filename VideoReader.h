@@ -0,0 +1,223 @@
+/**
+ * @file VideoReader.h
+ * @author Ori Garibi
+ * @brief locate the frames of the AVI and Y4M files written by VideoWriter.h, for the offline tools
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef VIDEOREADER_H
+#define VIDEOREADER_H
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+//where one frame is stored
+struct VideoFrame{
+    std::string file;
+    uint64_t offset; //first byte of the frame
+    uint64_t size;
+    uint64_t timeStamp; //Record timestamp (us), 0 when the file has none
+};
+
+inline uint32_t readLe32(const uint8_t *p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+inline uint64_t readLe64(const uint8_t *p){
+    return readLe32(p) | ((uint64_t)readLe32(p + 4) << 32);
+}
+inline uint64_t fileSize(std::ifstream &in){
+    in.clear();
+    in.seekg(0, std::ios::end);
+    const uint64_t size = (uint64_t)in.tellg();
+    in.seekg(0);
+    return size;
+}
+/**
+ * @brief files of one AVI trial in frame order: trialN.avi then trialN_1.avi, trialN_2.avi... while they exist
+ *
+ * @param segment path of any segment of the trial
+ * @return std::vector<std::string> segment paths
+ */
+inline std::vector<std::string> aviSegments(const std::string &segment){
+    std::string first(segment);
+    size_t dot = first.rfind('.');
+    const size_t underscore = first.rfind('_', dot);
+    const size_t slash = first.find_last_of("/\\");
+    if(dot != std::string::npos && underscore != std::string::npos && (slash == std::string::npos || underscore > slash)
+       && underscore + 1 < dot && first.find_first_not_of("0123456789", underscore + 1) == dot){ //trialN_K.avi, back to trialN.avi
+        first.erase(underscore, dot - underscore);
+        dot = underscore;
+    }
+    std::vector<std::string> paths(1, first);
+    for (int n = 1; ; n++)
+    {
+        const std::string suffix = "_" + std::to_string(n);
+        const std::string next = dot == std::string::npos ? first + suffix : first.substr(0, dot) + suffix + first.substr(dot);
+        if(!std::ifstream(next.c_str(), std::ios::binary)){
+            break;
+        }
+        paths.push_back(next);
+    }
+    return paths;
+}
+/**
+ * @brief append the 00dc payloads of one AVI segment, from idx1 or, when the save was cut short, from the frame table and the chunks after it
+ *
+ * @param path AVI written by AviSink
+ * @param frames filled in file order
+ * @return true the file has its idx1, false the frames were recovered from the frame table
+ */
+inline bool readAviFrames(const std::string &path, std::vector<VideoFrame> &frames){
+    std::ifstream in(path.c_str(), std::ios::binary);
+    const uint64_t end = fileSize(in); //RIFF sizes are stale in a file that was not finished
+    uint8_t head[12];
+    if(!in.read((char *)head, 12) || memcmp(head, "RIFF", 4) || memcmp(head + 8, "AVI ", 4)){
+        throw std::runtime_error(path + " is not an AVI file");
+    }
+    uint64_t pos = 12;
+    uint64_t table = 0; //frame table in the JUNK chunk, from the first page boundary after its header
+    uint64_t movi = 0; //position of the movi fourcc
+    std::vector<uint8_t> index;
+    while(pos + 12 <= end){
+        uint8_t chunk[12];
+        in.seekg(pos);
+        if(!in.read((char *)chunk, 12)){
+            break;
+        }
+        const uint32_t size = readLe32(chunk + 4);
+        if(!memcmp(chunk, "JUNK", 4) && !table){
+            table = (pos + 8 + 4095)/4096*4096;
+        }
+        else if(!memcmp(chunk, "LIST", 4) && !memcmp(chunk + 8, "movi", 4)){
+            movi = pos + 8;
+        }
+        else if(!memcmp(chunk, "idx1", 4)){
+            index.resize(size);
+            in.seekg(pos + 8);
+            if(!in.read((char *)index.data(), size)){
+                throw std::runtime_error(path + ": truncated idx1");
+            }
+        }
+        pos += 8 + size + (size & 1);
+    }
+    if(movi == 0){
+        throw std::runtime_error(path + ": no movi list");
+    }
+    in.clear();
+    //offset, size and timestamp of each frame, up to the last checkpoint
+    std::vector<uint8_t> entries;
+    if(table && table + 16 <= movi - 8){
+        entries.resize((size_t)(movi - 8 - table)/16*16);
+        in.seekg(table);
+        in.read((char *)entries.data(), entries.size());
+        in.clear();
+    }
+    const size_t first = frames.size();
+    if(!index.empty()){
+        for (size_t i = 0; i + 16 <= index.size(); i += 16)
+        {
+            VideoFrame f;
+            f.file = path;
+            f.offset = movi + readLe32(&index[i + 8]) + 8;
+            f.size = readLe32(&index[i + 12]);
+            f.timeStamp = 0;
+            if(i + 16 <= entries.size() && readLe32(&entries[i]) == readLe32(&index[i + 8])){ //both have 16 byte entries in frame order
+                f.timeStamp = readLe64(&entries[i + 8]);
+            }
+            frames.push_back(f);
+        }
+        return true;
+    }
+    for (size_t k = 0; k + 16 <= entries.size(); k += 16)
+    {
+        const uint32_t offset = readLe32(&entries[k]);
+        const uint32_t size = readLe32(&entries[k + 4]);
+        uint8_t chunk[8];
+        in.seekg(movi + offset);
+        if(size == 0 || movi + offset + 8 + size > end || !in.read((char *)chunk, 8) || memcmp(chunk, "00dc", 4) || readLe32(chunk + 4) != size){
+            break; //rest of the table was not written
+        }
+        VideoFrame f;
+        f.file = path;
+        f.offset = movi + offset + 8;
+        f.size = size;
+        f.timeStamp = readLe64(&entries[k + 8]);
+        frames.push_back(f);
+    }
+    //frames appended after the last checkpoint follow each other in movi, without timestamps
+    uint64_t next = frames.size() > first ? frames.back().offset + frames.back().size + (frames.back().size & 1) : movi + 4;
+    uint8_t chunk[8];
+    in.clear();
+    in.seekg(next);
+    while(next + 8 <= end && in.read((char *)chunk, 8) && !memcmp(chunk, "00dc", 4) && next + 8 + readLe32(chunk + 4) <= end){
+        VideoFrame f;
+        f.file = path;
+        f.offset = next + 8;
+        f.size = readLe32(chunk + 4);
+        f.timeStamp = 0;
+        frames.push_back(f);
+        next = f.offset + f.size + (f.size & 1);
+        in.seekg(next);
+    }
+    if(frames.size() == first){
+        throw std::runtime_error(path + ": no idx1 and no frame found, the save did not finish");
+    }
+    return false;
+}
+/**
+ * @brief frames of a Y4M written by Y4mSink, every frame is width*height Mono8 bytes after FRAME\n
+ *
+ * @param path Y4M file
+ * @param width filled from the W parameter
+ * @param height filled from the H parameter
+ * @return std::vector<VideoFrame> frames in file order, up to the first slot without its FRAME line: the file is preallocated, a crash leaves zeros after the last frame
+ */
+inline std::vector<VideoFrame> readY4mFrames(const std::string &path, size_t &width, size_t &height){
+    std::ifstream in(path.c_str(), std::ios::binary);
+    const uint64_t end = fileSize(in);
+    std::string header;
+    std::getline(in, header);
+    if(header.compare(0, 9, "YUV4MPEG2") != 0){
+        throw std::runtime_error(path + " is not a Y4M file");
+    }
+    width = 0;
+    height = 0;
+    std::stringstream ss(header);
+    std::string field;
+    while(ss >> field){
+        if(field[0] == 'W'){
+            width = std::stoul(field.substr(1));
+        }
+        else if(field[0] == 'H'){
+            height = std::stoul(field.substr(1));
+        }
+    }
+    if(!width || !height){
+        throw std::runtime_error(path + ": no frame size in the header");
+    }
+    std::vector<VideoFrame> frames;
+    for (uint64_t offset = header.size() + 1; offset + 6 + width*height <= end; offset += 6 + width*height)
+    {
+        char tag[6];
+        in.clear();
+        in.seekg(offset);
+        if(!in.read(tag, 6) || memcmp(tag, "FRAME\n", 6)){
+            break;
+        }
+        VideoFrame f;
+        f.file = path;
+        f.offset = offset + 6;
+        f.size = width*height;
+        f.timeStamp = 0;
+        frames.push_back(f);
+    }
+    return frames;
+}
+#endif
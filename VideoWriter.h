@@ -0,0 +1,640 @@
+/**
+ * @file VideoWriter.h
+ * @author Ori Garibi
+ * @brief single-file trial output: MJPEG AVI, raw Y4M or text appended through large sequential direct I/O blocks
+ * @version 0.1
+ * @date 2022-07-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef VIDEOWRITER_H
+#define VIDEOWRITER_H
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <stdexcept>
+#include "FileWriter.h"
+#include "JpegEncoder.h"
+
+//how the frames of a trial are saved
+enum VideoOutput {
+    OUTPUT_JPEG_FILES, //one frame.NNN.jpeg per frame
+    OUTPUT_AVI,        //one MJPEG AVI per trial
+    OUTPUT_Y4M         //one raw Y4M per trial, Mono8 only, no encoding
+};
+
+//appends to one file; bytes are gathered in aligned blocks so the disk only sees large sequential direct I/O writes
+class StreamSink : public FrameSink{
+    public:
+        StreamSink(FileWriter &writer, const std::string &path, uint64_t preallocate, size_t blockSize = 8 << 20, unsigned int blockCount = 4);
+        virtual ~StreamSink();
+        uint64_t getLength();
+        unsigned int getStalls();
+    protected:
+        void append(const uint8_t *data, size_t size);
+        void skip(uint64_t size);
+        void flushBlocks();
+        void rewrite(uint64_t offset, const uint8_t *buf, size_t size);
+        void writeAt(uint64_t offset, const uint8_t *buf, size_t size, WriteDone done);
+        void waitWrites();
+        void closeFile();
+        void reopen(const std::string &path, uint64_t preallocate);
+        uint64_t length; //bytes appended so far
+    private:
+        void writeBlock();
+        FileWriter &writer;
+        int file;
+        size_t blockSize;
+        std::vector<uint8_t *> blocks;
+        std::vector<uint8_t *> freeBlocks;
+        uint8_t *current;
+        size_t fill;
+        uint64_t blockOffset; //file offset of current
+        unsigned int stalls;
+        std::mutex lock;
+        std::condition_variable cond;
+};
+/**
+ * @brief Construct a new StreamSink:: StreamSink object and create the file
+ *
+ * @param writer1 backend that performs the writes
+ * @param path file to create
+ * @param preallocate expected file size, 0 when unknown
+ * @param blockSize1 bytes per write, a multiple of WRITER_ALIGN
+ * @param blockCount blocks that can wait in RAM for the disk
+ */
+StreamSink::StreamSink(FileWriter &writer1, const std::string &path, uint64_t preallocate, size_t blockSize1, unsigned int blockCount) : writer(writer1){
+    blockSize = alignUp(blockSize1);
+    length = 0;
+    fill = 0;
+    blockOffset = 0;
+    stalls = 0;
+    file = writer.open(path, preallocate, true);
+    for (unsigned int i = 0; i < blockCount; i++)
+    {
+        blocks.push_back(alignedAlloc(blockSize));
+        freeBlocks.push_back(blocks.back());
+    }
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+}
+StreamSink::~StreamSink(){
+    if(file >= 0){ //finish() was not reached, keep what was written
+        try {
+            flushBlocks();
+            closeFile();
+        }
+        catch (const std::exception &) {
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        alignedFree(blocks[i]);
+    }
+}
+uint64_t StreamSink::getLength(){
+    return length;
+}
+//number of times append waited for the disk
+unsigned int StreamSink::getStalls(){
+    std::unique_lock<std::mutex> guard(lock);
+    return stalls;
+}
+//copy bytes at the end of the file, full blocks are queued on the writer
+void StreamSink::append(const uint8_t *data, size_t size){
+    while(size){
+        size_t n = blockSize - fill < size ? blockSize - fill : size;
+        memcpy(current + fill, data, n);
+        fill += n;
+        data += n;
+        size -= n;
+        length += n;
+        if(fill == blockSize){
+            writeBlock();
+        }
+    }
+}
+//queue the current block and take a free one, waits while every block is in flight
+void StreamSink::writeBlock(){
+    uint8_t *buf = current;
+    writer.write(file, buf, fill, blockOffset, [this, buf]{
+        std::unique_lock<std::mutex> guard(lock);
+        freeBlocks.push_back(buf);
+        cond.notify_all();
+    });
+    blockOffset += fill;
+    fill = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    if(freeBlocks.empty()){ //disk is behind
+        ++stalls;
+        TraceSpan span("wait block", "write");
+        cond.wait(guard, [this]{ return !freeBlocks.empty(); });
+    }
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+}
+//leave a region the caller writes itself with writeAt(), at the start of the file only
+void StreamSink::skip(uint64_t size){
+    if(fill || size % WRITER_ALIGN){
+        throw std::runtime_error("skip needs an empty block and an aligned size");
+    }
+    length += size;
+    blockOffset += size;
+}
+//write the partial block and wait for every block; appending can go on afterwards
+void StreamSink::flushBlocks(){
+    if(fill){
+        writer.write(file, current, fill, blockOffset, WriteDone()); //padded to the alignment, the padding is cut at close
+    }
+    writer.wait(file);
+}
+/**
+ * @brief overwrite bytes already in the file, call flushBlocks() first
+ *
+ * @param offset aligned file offset
+ * @param buf alignedAlloc buffer
+ * @param size bytes, a multiple of WRITER_ALIGN unless the region ends the file
+ */
+void StreamSink::rewrite(uint64_t offset, const uint8_t *buf, size_t size){
+    writer.write(file, buf, size, offset, WriteDone());
+    writer.wait(file);
+}
+/**
+ * @brief queue a write of bytes outside the appended stream without waiting, buf is kept until done runs
+ *
+ * @param offset aligned file offset
+ * @param buf alignedAlloc buffer
+ * @param size bytes, a multiple of WRITER_ALIGN
+ * @param done called once the write has landed
+ */
+void StreamSink::writeAt(uint64_t offset, const uint8_t *buf, size_t size, WriteDone done){
+    writer.write(file, buf, size, offset, done);
+}
+//wait for every queued write, called by derived sinks before they free buffers given to writeAt()
+void StreamSink::waitWrites(){
+    if(file >= 0){
+        writer.wait(file);
+    }
+}
+//call flushBlocks() first
+void StreamSink::closeFile(){
+    int f = file;
+    file = -1;
+    writer.close(f, length);
+}
+//continue in a new file after closeFile(), the blocks are reused
+void StreamSink::reopen(const std::string &path, uint64_t preallocate){
+    file = writer.open(path, preallocate, true);
+    length = 0;
+    fill = 0;
+    blockOffset = 0;
+}
+
+//MJPEG AVI with a single video stream and an idx1 index, headers are patched once the frame count is known.
+//a frame table (offset, size, timestamp) reserved in the JUNK chunk before movi is written back every second,
+//so a file cut short by a crash still locates its frames; near 4 GB the trial goes on in trialN_1.avi, trialN_2.avi...
+class AviSink : public StreamSink{
+    public:
+        AviSink(FileWriter &writer, const std::string &path, size_t width, size_t height, int fps, size_t expectedFrames);
+        ~AviSink();
+        void put(int64_t index, const uint8_t *data, size_t size, WriteDone done);
+        void setFrameTime(int64_t index, uint64_t timeStamp);
+        void finish();
+        int getSegments();
+    private:
+        struct IndexEntry{
+            uint32_t offset; //from the movi fourcc
+            uint32_t size;
+        };
+        void startSegment();
+        void finishSegment();
+        void checkpoint();
+        std::string segmentPath(int segment);
+        void header(uint8_t *buf, uint32_t frames, uint32_t period, uint32_t maxFrame, uint64_t moviSize);
+        uint32_t framePeriod();
+        std::string path;
+        size_t width;
+        size_t height;
+        int fps;
+        size_t expectedFrames;
+        size_t written; //frames put in every segment
+        int segment;
+        std::vector<IndexEntry> index; //frames of the current segment
+        std::vector<uint64_t> times; //Record timestamps by frame index
+        uint64_t firstTime; //first and last timestamps of the segment, set the frame period of the header
+        uint64_t lastTime;
+        uint32_t maxFrame;
+        size_t tableCapacity; //frame table entries reserved in the current segment
+        size_t headerSize; //header page plus the frame table, movi starts here
+        uint8_t *headerBuf; //header and frame table as they will be in the file
+        uint8_t *snapshot; //copy handed to the writer, changed only while no checkpoint is in flight
+        size_t snapshotSize;
+        size_t saved; //table entries already in a checkpoint
+        std::atomic<int> inFlight; //checkpoint writes not landed yet
+        bool finished;
+};
+//hdrl and a JUNK pad fill the first block so the frames start aligned and the header can be rewritten in place
+static const size_t AVI_HEADER_SIZE = WRITER_ALIGN;
+static const uint64_t AVI_MAX_SIZE = 0xFFFFFFF0ull; //RIFF sizes are 32 bit
+static const size_t AVI_TABLE_ENTRY = 16; //offset from the movi fourcc, size, Record timestamp (us)
+
+inline void put16(uint8_t *&p, uint16_t v){
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p += 2;
+}
+inline void put32(uint8_t *&p, uint32_t v){
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    p += 4;
+}
+inline void put64(uint8_t *&p, uint64_t v){
+    put32(p, (uint32_t)v);
+    put32(p, (uint32_t)(v >> 32));
+}
+inline void putFourcc(uint8_t *&p, const char *fourcc){
+    memcpy(p, fourcc, 4);
+    p += 4;
+}
+/**
+ * @brief Construct a new AviSink:: AviSink object and reserve the header and the frame table
+ *
+ * @param writer backend that performs the writes
+ * @param path1 .avi file to create, later segments get _1, _2... before the extension
+ * @param width1 pixels per line
+ * @param height1 lines per frame
+ * @param fps1 nominal frame rate, used when the frames carry no timestamps
+ * @param expectedFrames1 frames of the trial, the frame table is reserved for them up front
+ */
+AviSink::AviSink(FileWriter &writer, const std::string &path1, size_t width1, size_t height1, int fps1, size_t expectedFrames1)
+    : StreamSink(writer, path1, 0){
+    path = path1;
+    width = width1;
+    height = height1;
+    fps = fps1 > 0 ? fps1 : 1;
+    expectedFrames = expectedFrames1;
+    written = 0;
+    segment = 0;
+    times.reserve(expectedFrames);
+    headerBuf = NULL;
+    snapshot = NULL;
+    snapshotSize = 0;
+    inFlight = 0;
+    finished = false;
+    startSegment();
+}
+AviSink::~AviSink(){
+    try {
+        waitWrites(); //checkpoints still read snapshot
+    }
+    catch (const std::exception &) {
+    }
+    alignedFree(headerBuf);
+    alignedFree(snapshot);
+}
+int AviSink::getSegments(){
+    return segment + 1;
+}
+std::string AviSink::segmentPath(int n){
+    if(n == 0){
+        return path;
+    }
+    const size_t dot = path.rfind('.');
+    const std::string suffix = "_" + std::to_string(n);
+    return dot == std::string::npos ? path + suffix : path.substr(0, dot) + suffix + path.substr(dot);
+}
+//reserve the header and a frame table for the frames still expected, then write both so the file is valid from the start
+void AviSink::startSegment(){
+    index.clear();
+    maxFrame = 0;
+    firstTime = 0;
+    lastTime = 0;
+    saved = 0;
+    tableCapacity = expectedFrames > written ? expectedFrames - written : 1;
+    headerSize = AVI_HEADER_SIZE + alignUp(AVI_TABLE_ENTRY*tableCapacity + 12); //the movi list header ends the table region
+    alignedFree(headerBuf);
+    headerBuf = alignedAlloc(headerSize);
+    memset(headerBuf, 0, headerSize);
+    if(snapshotSize < headerSize){
+        alignedFree(snapshot);
+        snapshot = alignedAlloc(headerSize);
+        snapshotSize = headerSize;
+    }
+    header(headerBuf, 0, 1000000/fps, 0, 4);
+    skip(headerSize);
+    memcpy(snapshot, headerBuf, headerSize);
+    inFlight = 1;
+    writeAt(0, snapshot, headerSize, [this]{ --inFlight; });
+}
+/**
+ * @brief append one encoded frame as a 00dc chunk, in a new segment when this one would pass 4 GB
+ *
+ * @param frameIndex frame index, frames arrive in order
+ * @param data JPEG bytes
+ * @param size number of bytes
+ * @param done called once data has been copied
+ */
+void AviSink::put(int64_t frameIndex, const uint8_t *data, size_t size, WriteDone done){
+    const size_t padded = size + (size & 1); //chunks are word aligned
+    if(!index.empty() && length + 8 + padded + 16*(index.size() + 1) + 8 > AVI_MAX_SIZE){
+        finishSegment();
+        ++segment;
+        reopen(segmentPath(segment), 0);
+        startSegment();
+    }
+    if(length + 8 + padded + 16 + 8 > AVI_MAX_SIZE){ //the caller releases data when put throws
+        throw std::runtime_error("AVI frame " + std::to_string(frameIndex) + " does not fit in 4 GB");
+    }
+    const uint64_t timeStamp = frameIndex >= 0 && (size_t)frameIndex < times.size() ? times[frameIndex] : 0;
+    uint8_t chunk[8];
+    uint8_t *p = chunk;
+    putFourcc(p, "00dc");
+    put32(p, (uint32_t)size);
+    IndexEntry e;
+    e.offset = (uint32_t)(length - (headerSize - 4));
+    e.size = (uint32_t)size;
+    if(index.size() < tableCapacity){
+        p = headerBuf + AVI_HEADER_SIZE + AVI_TABLE_ENTRY*index.size();
+        put32(p, e.offset);
+        put32(p, e.size);
+        put64(p, timeStamp);
+    }
+    index.push_back(e);
+    ++written;
+    if(size > maxFrame){
+        maxFrame = (uint32_t)size;
+    }
+    if(timeStamp){
+        if(!firstTime){
+            firstTime = timeStamp;
+        }
+        lastTime = timeStamp;
+    }
+    logChecksum(frameIndex, size, crc32c(0, data, size));
+    append(chunk, 8);
+    append(data, size);
+    if(done){
+        done();
+    }
+    if(padded != size){
+        const uint8_t zero = 0;
+        append(&zero, 1);
+    }
+    if(index.size() - saved >= (size_t)fps && inFlight == 0){
+        checkpoint();
+    }
+}
+void AviSink::setFrameTime(int64_t frameIndex, uint64_t timeStamp){
+    if(frameIndex < 0){
+        return;
+    }
+    if((size_t)frameIndex >= times.size()){
+        times.resize(frameIndex + 1, 0);
+    }
+    times[frameIndex] = timeStamp;
+}
+//measured frame period of the segment, so seeking by time matches the CSV
+uint32_t AviSink::framePeriod(){
+    uint32_t us = 1000000/fps;
+    if(index.size() > 1 && lastTime > firstTime){
+        us = (uint32_t)((lastTime - firstTime)/(index.size() - 1));
+    }
+    return us ? us : 1;
+}
+//write the header with the current counts and the table pages filled since the last checkpoint, without waiting
+void AviSink::checkpoint(){
+    const size_t entries = index.size() < tableCapacity ? index.size() : tableCapacity;
+    const size_t from = AVI_HEADER_SIZE + (AVI_TABLE_ENTRY*saved/WRITER_ALIGN)*WRITER_ALIGN;
+    const size_t to = AVI_HEADER_SIZE + alignUp(AVI_TABLE_ENTRY*entries);
+    header(headerBuf, (uint32_t)index.size(), framePeriod(), maxFrame, length - (headerSize - 4));
+    memcpy(snapshot, headerBuf, AVI_HEADER_SIZE);
+    inFlight = to > from ? 2 : 1;
+    if(to > from){
+        memcpy(snapshot + from, headerBuf + from, to - from);
+        writeAt(from, snapshot + from, to - from, [this]{ --inFlight; });
+    }
+    writeAt(0, snapshot, AVI_HEADER_SIZE, [this]{ --inFlight; });
+    saved = entries;
+}
+//append idx1, patch the counts and sizes of the header and close the file
+void AviSink::finishSegment(){
+    const uint64_t moviSize = length - (headerSize - 4);
+    uint8_t entry[16];
+    uint8_t *p = entry;
+    putFourcc(p, "idx1");
+    put32(p, (uint32_t)(16*index.size()));
+    append(entry, 8);
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        p = entry;
+        putFourcc(p, "00dc");
+        put32(p, 0x10); //AVIIF_KEYFRAME, every MJPEG frame is one
+        put32(p, index[i].offset);
+        put32(p, index[i].size);
+        append(entry, 16);
+    }
+    flushBlocks(); //checkpoints included, snapshot is free again
+    header(headerBuf, (uint32_t)index.size(), framePeriod(), maxFrame, moviSize);
+    rewrite(0, headerBuf, headerSize);
+    closeFile();
+}
+void AviSink::finish(){
+    if(finished){
+        return;
+    }
+    finished = true;
+    finishSegment();
+}
+/**
+ * @brief build the RIFF, hdrl, JUNK and movi list headers
+ *
+ * @param buf headerSize bytes, only the first page and the movi list header are rebuilt
+ * @param frames frames in the file
+ * @param period microseconds per frame
+ * @param maxFrame largest chunk, suggested buffer size for players
+ * @param moviSize size of the movi list from its fourcc
+ */
+void AviSink::header(uint8_t *buf, uint32_t frames, uint32_t period, uint32_t maxFrame1, uint64_t moviSize){
+    memset(buf, 0, AVI_HEADER_SIZE); //the frame table after the first page is kept
+    const uint64_t riffSize = headerSize - 8 + (moviSize - 4) + 8 + 16ull*frames;
+    uint8_t *p = buf;
+    putFourcc(p, "RIFF");
+    put32(p, (uint32_t)riffSize);
+    putFourcc(p, "AVI ");
+    putFourcc(p, "LIST");
+    put32(p, 4 + 64 + 12 + 64 + 48);
+    putFourcc(p, "hdrl");
+    putFourcc(p, "avih");
+    put32(p, 56);
+    put32(p, period); //dwMicroSecPerFrame
+    put32(p, (uint32_t)((uint64_t)maxFrame1*1000000/period)); //dwMaxBytesPerSec
+    put32(p, 0); //dwPaddingGranularity
+    put32(p, 0x10); //AVIF_HASINDEX
+    put32(p, frames);
+    put32(p, 0); //dwInitialFrames
+    put32(p, 1); //dwStreams
+    put32(p, maxFrame1);
+    put32(p, (uint32_t)width);
+    put32(p, (uint32_t)height);
+    p += 16; //dwReserved
+    putFourcc(p, "LIST");
+    put32(p, 4 + 64 + 48);
+    putFourcc(p, "strl");
+    putFourcc(p, "strh");
+    put32(p, 56);
+    putFourcc(p, "vids");
+    putFourcc(p, "MJPG");
+    put32(p, 0); //dwFlags
+    put16(p, 0); //wPriority
+    put16(p, 0); //wLanguage
+    put32(p, 0); //dwInitialFrames
+    put32(p, period); //dwScale
+    put32(p, 1000000); //dwRate, frame rate is dwRate/dwScale
+    put32(p, 0); //dwStart
+    put32(p, frames); //dwLength
+    put32(p, maxFrame1);
+    put32(p, 0xFFFFFFFF); //dwQuality, default
+    put32(p, 0); //dwSampleSize, frames vary in size
+    put16(p, 0);
+    put16(p, 0);
+    put16(p, (uint16_t)width);
+    put16(p, (uint16_t)height);
+    putFourcc(p, "strf");
+    put32(p, 40);
+    put32(p, 40); //BITMAPINFOHEADER
+    put32(p, (uint32_t)width);
+    put32(p, (uint32_t)height);
+    put16(p, 1);
+    put16(p, 24);
+    putFourcc(p, "MJPG");
+    put32(p, (uint32_t)(width*height*3));
+    p += 16; //resolution and palette
+    const size_t junk = headerSize - (p - buf) - 8 - 12; //pads to the page and holds the frame table
+    putFourcc(p, "JUNK");
+    put32(p, (uint32_t)junk);
+    p += junk;
+    putFourcc(p, "LIST");
+    put32(p, (uint32_t)moviSize);
+    putFourcc(p, "movi");
+}
+
+//raw Mono8 frames in a Y4M stream, the same layout as the preview but at full resolution
+class Y4mSink : public StreamSink{
+    public:
+        Y4mSink(FileWriter &writer, const std::string &path, size_t width, size_t height, size_t pitch, int fps, size_t expectedFrames);
+        void put(int64_t index, const uint8_t *data, size_t size, WriteDone done);
+        void finish();
+    private:
+        size_t width;
+        size_t height;
+        size_t pitch;
+        bool finished;
+};
+/**
+ * @brief Construct a new Y4mSink:: Y4mSink object, create the file and write the stream header
+ *
+ * @param writer backend that performs the writes
+ * @param path .y4m file to create
+ * @param width1 pixels per line
+ * @param height1 lines per frame
+ * @param pitch1 bytes between two lines of the frames given to put
+ * @param fps frame rate written in the header
+ * @param expectedFrames frames of the trial, used to preallocate the file
+ */
+Y4mSink::Y4mSink(FileWriter &writer, const std::string &path, size_t width1, size_t height1, size_t pitch1, int fps, size_t expectedFrames)
+    : StreamSink(writer, path, 64 + (uint64_t)(6 + width1*height1)*expectedFrames){
+    width = width1;
+    height = height1;
+    pitch = pitch1;
+    finished = false;
+    std::stringstream ss;
+    ss << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 Cmono\n";
+    const std::string h = ss.str();
+    append((const uint8_t *)h.data(), h.size());
+}
+/**
+ * @brief append one stitched frame
+ *
+ * @param frameIndex frame index, frames arrive in order
+ * @param data first line of the frame
+ * @param size bytes of the frame, pitch*height
+ * @param done called once data has been copied
+ */
+void Y4mSink::put(int64_t frameIndex, const uint8_t *data, size_t size, WriteDone done){
+    if(size < pitch*(height - 1) + width){
+        throw std::runtime_error("y4m frame is too small");
+    }
+    append((const uint8_t *)"FRAME\n", 6);
+    uint32_t crc = 0;
+    if(pitch == width){
+        append(data, width*height);
+        crc = crc32c(0, data, width*height);
+    }
+    else{
+        for (size_t y = 0; y < height; y++)
+        {
+            append(data + y*pitch, width);
+            crc = crc32c(crc, data + y*pitch, width);
+        }
+    }
+    logChecksum(frameIndex, width*height, crc); //pixels only, the FRAME line is not part of it
+    if(done){
+        done();
+    }
+}
+void Y4mSink::finish(){
+    if(finished){
+        return;
+    }
+    finished = true;
+    flushBlocks();
+    closeFile();
+}
+
+//text such as the timestamp CSV of a trial, appended through the same blocks so the save loop never waits on a small write
+class TextSink : public StreamSink{
+    public:
+        TextSink(FileWriter &writer, const std::string &path);
+        void put(int64_t index, const uint8_t *data, size_t size, WriteDone done);
+        void write(const std::string &text);
+        void finish();
+    private:
+        bool finished;
+};
+/**
+ * @brief Construct a new TextSink:: TextSink object and create the file
+ *
+ * @param writer backend that performs the writes
+ * @param path text file to create, its size is not known ahead
+ */
+TextSink::TextSink(FileWriter &writer, const std::string &path) : StreamSink(writer, path, 0, 1 << 20){
+    finished = false;
+}
+//append bytes as they are, index is not used
+void TextSink::put(int64_t, const uint8_t *data, size_t size, WriteDone done){
+    append(data, size);
+    if(done){
+        done();
+    }
+}
+void TextSink::write(const std::string &text){
+    append((const uint8_t *)text.data(), text.size());
+}
+void TextSink::finish(){
+    if(finished){
+        return;
+    }
+    finished = true;
+    flushBlocks();
+    closeFile();
+}
+#endif
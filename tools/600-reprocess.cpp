@@ -0,0 +1,417 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <turbojpeg.h>
+
+#include "tools.h"
+#include "../VideoReader.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+struct Crop {
+    int x;
+    int y;
+    int width;  // 0 keeps the full width
+    int height; // 0 keeps the full height
+};
+
+// one frame to re-encode: a frame.NNN.jpeg file, or a JPEG or raw Mono8 frame inside the trial video
+struct Source {
+    fs::path file;
+    uint64_t offset;
+    uint64_t size;     // 0 for a whole JPEG file
+    bool raw;          // Mono8 pixels from a Y4M
+    int width;         // raw frames only
+    int height;
+    std::string name;  // output file name
+};
+
+struct Job {
+    fs::path input;
+    fs::path output;
+};
+
+struct Totals {
+    uint64_t frames;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    unsigned int trials;
+    unsigned int skipped;
+};
+
+// bytes held by the workers at any time, a trial waits until its working set fits
+class MemoryBudget {
+    public:
+        MemoryBudget(uint64_t limit): limit(limit), used(0) {}
+        void acquire(uint64_t bytes) {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this, bytes]{ return used == 0 || used + bytes <= limit; });
+            used += bytes;
+        }
+        void release(uint64_t bytes) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                used -= bytes;
+            }
+            cond.notify_all();
+        }
+    private:
+        uint64_t limit;
+        uint64_t used;
+        std::mutex lock;
+        std::condition_variable cond;
+};
+
+Crop parseCrop(const std::string &value) {
+    Crop crop = {0, 0, 0, 0};
+    if (!value.empty() && std::sscanf(value.c_str(), "%d,%d,%d,%d", &crop.x, &crop.y, &crop.width, &crop.height) != 4) {
+        throw std::runtime_error("--crop expects x,y,width,height");
+    }
+    if (crop.x < 0 || crop.y < 0 || crop.width < 0 || crop.height < 0) {
+        throw std::runtime_error("--crop " + value + ": values must not be negative");
+    }
+    return crop;
+}
+
+std::vector<char> readFile(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("could not read " + path.string());
+    }
+    return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+std::vector<char> readRange(const fs::path &path, uint64_t offset, uint64_t size) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> data(size);
+    in.seekg(offset);
+    if (!in.read(data.data(), size)) {
+        throw std::runtime_error("could not read " + Tools::toString(size) + " bytes at " + Tools::toString(offset) + " of " + path.string());
+    }
+    return data;
+}
+
+// same names as the capture writes with OUTPUT_JPEG_FILES
+std::string frameName(size_t index) {
+    std::stringstream ss;
+    ss << "frame." << std::setw(3) << std::setfill('0') << index << ".jpeg";
+    return ss.str();
+}
+
+// frames of a trial in order, from its JPEG files or from its AVI segments or Y4M
+std::vector<Source> findFrames(const Job &job) {
+    std::vector<Source> sources;
+    fs::path avi, y4m;
+    for (fs::directory_iterator it(job.input); it != fs::directory_iterator(); ++it) {
+        const std::string name(it->path().filename().string());
+        if (name.find("frame.") == 0 && it->path().extension() == ".jpeg") {
+            Source src = {it->path(), 0, 0, false, 0, 0, name};
+            sources.push_back(src);
+        } else if (name.find("trial") == 0 && it->path().extension() == ".avi") {
+            avi = it->path();
+        } else if (name.find("trial") == 0 && it->path().extension() == ".y4m") {
+            y4m = it->path();
+        } else if (it->path().extension() == ".csv") { // timestamps keep the frame mapping
+            fs::copy_file(it->path(), job.output / it->path().filename(), fs::copy_options::overwrite_existing);
+        }
+    }
+    if (!sources.empty()) {
+        std::sort(sources.begin(), sources.end(), [](const Source &a, const Source &b) { return a.name < b.name; });
+        return sources;
+    }
+    std::vector<VideoFrame> frames;
+    size_t width = 0, height = 0;
+    if (!avi.empty()) {
+        const std::vector<std::string> segments(aviSegments(avi.string()));
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (!readAviFrames(segments[i], frames)) {
+                Tools::log(segments[i] + " has no idx1, frames located from its frame table");
+            }
+        }
+    } else if (!y4m.empty()) {
+        frames = readY4mFrames(y4m.string(), width, height);
+    }
+    for (size_t i = 0; i < frames.size(); ++i) {
+        Source src = {frames[i].file, frames[i].offset, frames[i].size, width != 0, (int)width, (int)height, frameName(i)};
+        sources.push_back(src);
+    }
+    return sources;
+}
+
+// write to a temporary name first so an interrupted run never leaves a truncated frame behind
+void writeFile(const fs::path &path, const unsigned char *data, size_t size) {
+    fs::path tmp(path.string() + ".part");
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write((const char *)data, size);
+        if (!out) {
+            throw std::runtime_error("could not write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+}
+
+// every camera writes its timestamps next to its frames
+bool hasTimestamps(const fs::path &dir) {
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        if (it->path().filename().string().find("timeStamps_trial") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// TrialN holds the frames of an unnamed camera, TrialN/<camera> those of each named one
+std::vector<Job> findTrials(const fs::path &inputRoot, const fs::path &outputRoot) {
+    std::vector<Job> jobs;
+    for (fs::directory_iterator it(inputRoot); it != fs::directory_iterator(); ++it) {
+        if (!it->is_directory() || it->path().filename().string().find("Trial") != 0) {
+            continue;
+        }
+        const fs::path trial(outputRoot / it->path().filename());
+        if (hasTimestamps(it->path())) {
+            Job job;
+            job.input = it->path();
+            job.output = trial;
+            jobs.push_back(job);
+        }
+        for (fs::directory_iterator cam(it->path()); cam != fs::directory_iterator(); ++cam) {
+            if (cam->is_directory() && hasTimestamps(cam->path())) {
+                Job job;
+                job.input = cam->path();
+                job.output = trial / cam->path().filename();
+                jobs.push_back(job);
+            }
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.input < b.input; });
+    return jobs;
+}
+
+// one worker keeps its TurboJPEG handles for every trial it processes, the buffers only for the trial in progress
+class Reprocessor {
+    public:
+        Reprocessor(int quality, int flags, const Crop &crop, MemoryBudget &budget)
+        : quality(quality), flags(flags), crop(crop), budget(budget), charged(0), decoder(tjInitDecompress()), encoder(tjInitCompress())
+        {}
+        ~Reprocessor() {
+            release();
+            tjDestroy(decoder);
+            tjDestroy(encoder);
+        }
+        Totals run(const Job &job);
+    private:
+        void frame(const Source &source, const fs::path &output, Totals &totals);
+        void charge(uint64_t bytes);
+        void release();
+        int quality;
+        int flags;
+        Crop crop;
+        MemoryBudget &budget;
+        uint64_t charged; // bytes of pixels and encoded held against the budget
+        tjhandle decoder;
+        tjhandle encoder;
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> encoded;
+};
+
+// frames of a trial share one size, so this waits once per trial and again only if a larger frame shows up
+void Reprocessor::charge(uint64_t bytes) {
+    if (bytes <= charged) {
+        return;
+    }
+    if (charged) { // give back the smaller share first, two workers growing at once would wait on each other
+        budget.release(charged);
+        charged = 0;
+    }
+    budget.acquire(bytes);
+    charged = bytes;
+}
+
+// free the buffers of the finished trial, an idle worker holds no memory
+void Reprocessor::release() {
+    std::vector<unsigned char>().swap(pixels);
+    std::vector<unsigned char>().swap(encoded);
+    if (charged) {
+        budget.release(charged);
+        charged = 0;
+    }
+}
+
+Totals Reprocessor::run(const Job &job) {
+    Totals totals = {0, 0, 0, 0, 0};
+    if (fs::exists(job.output / ".done")) { // finished by an earlier run
+        totals.skipped = 1;
+        return totals;
+    }
+    fs::create_directories(job.output);
+    std::vector<Source> frames(findFrames(job));
+    try {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            fs::path output(job.output / frames[i].name);
+            if (fs::exists(output)) { // resumed trial, frame already written
+                continue;
+            }
+            frame(frames[i], output, totals);
+        }
+    }
+    catch (...) {
+        release();
+        throw;
+    }
+    release();
+    std::ofstream(job.output / ".done") << totals.frames << "\n";
+    totals.trials = 1;
+    return totals;
+}
+
+void Reprocessor::frame(const Source &source, const fs::path &output, Totals &totals) {
+    const std::string input(source.size ? source.file.string() + " " + source.name : source.file.string());
+    std::vector<char> jpeg;
+    int width = source.width, height = source.height, subsampling = TJSAMP_GRAY, colorspace;
+    if (!source.raw) {
+        jpeg = source.size ? readRange(source.file, source.offset, source.size) : readFile(source.file);
+        if (tjDecompressHeader3(decoder, (const unsigned char *)jpeg.data(), jpeg.size(), &width, &height, &subsampling, &colorspace)) {
+            throw std::runtime_error(input + ": " + tjGetErrorStr2(decoder));
+        }
+    }
+    const bool gray = subsampling == TJSAMP_GRAY;
+    const int channels = gray ? 1 : 3;
+    const int pixelFormat = gray ? TJPF_GRAY : TJPF_RGB;
+    if (crop.x >= width || crop.y >= height || crop.x + crop.width > width || crop.y + crop.height > height) {
+        std::stringstream ss;
+        ss << input << ": --crop " << crop.x << "," << crop.y << "," << crop.width << "," << crop.height
+           << " does not fit in the " << width << "x" << height << " frame";
+        throw std::runtime_error(ss.str());
+    }
+    const int w = crop.width ? crop.width : width - crop.x;
+    const int h = crop.height ? crop.height : height - crop.y;
+    const size_t needed = (size_t)width * height * channels;
+    const size_t outSize = tjBufSize(w, h, subsampling);
+    charge(needed + outSize);
+    if (pixels.size() < needed) {
+        pixels.resize(needed);
+    }
+    if (encoded.size() < outSize) {
+        encoded.resize(outSize);
+    }
+    if (source.raw) { // Y4M frames are stored without line padding
+        std::ifstream in(source.file, std::ios::binary);
+        in.seekg(source.offset);
+        if (!in.read((char *)pixels.data(), needed)) {
+            throw std::runtime_error(input + ": truncated frame");
+        }
+    } else if (tjDecompress2(decoder, (const unsigned char *)jpeg.data(), jpeg.size(), pixels.data(), width, width * channels, height, pixelFormat, 0)) {
+        throw std::runtime_error(input + ": " + tjGetErrorStr2(decoder));
+    }
+    unsigned char *out = encoded.data();
+    unsigned long size = encoded.size();
+    const unsigned char *src = pixels.data() + ((size_t)crop.y * width + crop.x) * channels;
+    if (tjCompress2(encoder, src, w, width * channels, h, pixelFormat, &out, &size, subsampling, quality, flags)) {
+        throw std::runtime_error(input + ": " + tjGetErrorStr2(encoder));
+    }
+    writeFile(output, out, size);
+    totals.frames += 1;
+    totals.bytesIn += source.raw ? needed : jpeg.size();
+    totals.bytesOut += size;
+}
+
+void reprocess() {
+    const fs::path inputRoot(Tools::getOption("input", "D:/cameraOutput"));
+    std::string output(Tools::getOption("output", ""));
+    if (output.empty()) { // the sample output path is only looked up when it is used
+        output = Tools::getEnv("sample-output-path");
+    }
+    const fs::path outputRoot(output);
+    const int quality = std::atoi(Tools::getOption("quality", "90").c_str());
+    const Crop crop(parseCrop(Tools::getOption("crop", "")));
+    unsigned int jobsCount = std::atoi(Tools::getOption("jobs", "0").c_str());
+    if (jobsCount == 0) {
+        jobsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // the fast DCT is visibly coarser at high quality, only for quick previews
+    const int flags = TJFLAG_NOREALLOC | (Tools::getOption("fast-dct", "0") == "1" ? TJFLAG_FASTDCT : 0);
+    // each worker charges its decoded frame plus encoder output once it has read the first frame of a trial
+    MemoryBudget budget(std::strtoull(Tools::getOption("memory-mb", "2048").c_str(), NULL, 10) << 20);
+
+    std::vector<Job> jobs(findTrials(inputRoot, outputRoot));
+    Tools::log("Found " + Tools::toString(jobs.size()) + " trials in " + inputRoot.string() + ", " + Tools::toString(jobsCount) + " workers");
+    std::deque<Job> queue(jobs.begin(), jobs.end());
+    std::mutex lock;
+    Totals totals = {0, 0, 0, 0, 0};
+    std::vector<std::string> errors;
+    const uint64_t start = Tools::getTimestamp();
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < jobsCount; ++i) {
+        workers.push_back(std::thread([&]() {
+            Reprocessor worker(quality, flags, crop, budget);
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    if (queue.empty()) {
+                        return;
+                    }
+                    job = queue.front();
+                    queue.pop_front();
+                }
+                try {
+                    const uint64_t t0 = Tools::getTimestamp();
+                    Totals t(worker.run(job));
+                    const double seconds = (Tools::getTimestamp() - t0) / 1e6;
+                    std::unique_lock<std::mutex> guard(lock);
+                    totals.frames += t.frames;
+                    totals.bytesIn += t.bytesIn;
+                    totals.bytesOut += t.bytesOut;
+                    totals.trials += t.trials;
+                    totals.skipped += t.skipped;
+                    if (t.trials) {
+                        Tools::log(job.input.filename().string() + ": " + Tools::toString(t.frames) + " frames in " + Tools::toString(seconds) + " s");
+                    }
+                }
+                catch (const std::exception &e) {
+                    std::unique_lock<std::mutex> guard(lock);
+                    errors.push_back(job.input.string() + ": " + e.what());
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    const double seconds = std::max(1e-6, (Tools::getTimestamp() - start) / 1e6);
+    std::stringstream ss;
+    ss << totals.trials << " trials (" << totals.skipped << " already done), " << totals.frames << " frames in " << seconds << " s: "
+       << totals.frames / seconds << " frames/s, " << totals.bytesIn / seconds / 1e6 << " MB/s read, "
+       << totals.bytesOut / seconds / 1e6 << " MB/s written";
+    Tools::log(ss.str());
+    for (size_t i = 0; i < errors.size(); ++i) {
+        Tools::log("failed " + errors[i]);
+    }
+    if (!errors.empty()) {
+        throw std::runtime_error(Tools::toString(errors.size()) + " trials failed, rerun to resume");
+    }
+}
+
+} // anonymous
+
+static Tools::Sample addSample(__FILE__, reprocess,
+    "Re-encode or crop every saved trial under --input (default D:/cameraOutput) into --output frame.NNN.jpeg files\n"
+    "options: --quality <1-100> --crop x,y,width,height --jobs <n> --memory-mb <budget> --fast-dct 1\n"
+    "reads frame.NNN.jpeg files, trialN.avi with its _1, _2... segments, or trialN.y4m, in TrialN and in each TrialN/<camera>\n"
+    "finished trials are marked with .done and skipped, so an interrupted run resumes");
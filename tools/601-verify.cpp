@@ -0,0 +1,282 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "tools.h"
+#include "../Crc32c.h"
+#include "../VideoReader.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// one saved frame: where its bytes are and what they should hash to
+struct FrameCheck {
+    size_t trial;
+    int64_t index;
+    fs::path file;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t crc;
+};
+
+struct TrialResult {
+    fs::path dir;
+    std::string container;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t badFrames;
+    uint64_t rows;
+    uint64_t badRows;
+    std::vector<std::string> problems;
+};
+
+std::vector<std::string> splitCsv(const std::string &line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+std::string firstMatch(const fs::path &dir, const std::string &prefix, const std::string &extension) {
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        const std::string name(it->path().filename().string());
+        if (name.find(prefix) == 0 && it->path().extension() == extension) {
+            return it->path().string();
+        }
+    }
+    return "";
+}
+
+// row CRC is the last column and covers the text before it; for Y4M the frame CRC column is also the CRC of the stored pixels
+void checkRows(TrialResult &result, uint64_t expectedRows, const std::map<int64_t, uint32_t> &storedCrcs) {
+    const std::string csv = firstMatch(result.dir, "timeStamps_trial", ".csv");
+    if (csv.empty()) {
+        result.problems.push_back("no timestamp CSV");
+        return;
+    }
+    std::ifstream in(csv);
+    std::string line;
+    std::getline(in, line); // header
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    const std::vector<std::string> header(splitCsv(line));
+    const size_t frameCrc = std::find(header.begin(), header.end(), "Frame CRC32C") - header.begin();
+    uint64_t badCrcs = 0;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        ++result.rows;
+        if (!storedCrcs.empty() && frameCrc < header.size()) {
+            const std::vector<std::string> f(splitCsv(line));
+            const std::map<int64_t, uint32_t>::const_iterator stored = f.size() > frameCrc ? storedCrcs.find(std::strtoll(f[0].c_str(), NULL, 10)) : storedCrcs.end();
+            if (stored != storedCrcs.end() && (uint32_t)std::strtoul(f[frameCrc].c_str(), NULL, 16) != stored->second) {
+                ++result.badFrames; // changed between stitching and the sink
+                if (++badCrcs <= 10) {
+                    result.problems.push_back("frame " + f[0] + " was stored with other pixels than it was stitched with");
+                }
+            }
+        }
+        const size_t comma = line.rfind(',');
+        const std::string text = comma == std::string::npos ? line : line.substr(0, comma);
+        const std::string stored = comma == std::string::npos ? "" : line.substr(comma + 1);
+        if (crc32cHex(crc32c(0, (const uint8_t *)text.data(), text.size())) != stored) {
+            ++result.badRows;
+            if (result.badRows <= 10) {
+                result.problems.push_back("row " + Tools::toString(result.rows) + " does not match its CRC");
+            }
+        }
+    }
+    if (result.rows != expectedRows) {
+        result.problems.push_back(Tools::toString(result.rows) + " CSV rows for " + Tools::toString(expectedRows) + " saved frames");
+    }
+}
+
+// reads the checksum list of a trial and turns it into frame checks on the file(s) that hold the frames
+void planTrial(size_t trial, TrialResult &result, std::vector<FrameCheck> &checks) {
+    const std::string list = firstMatch(result.dir, "checksums_trial", ".csv");
+    std::ifstream in(list);
+    std::string line;
+    std::getline(in, line); // header
+    std::vector<FrameCheck> frames;
+    while (std::getline(in, line)) {
+        std::vector<std::string> f(splitCsv(line));
+        if (f.size() < 3) {
+            continue;
+        }
+        FrameCheck c;
+        c.trial = trial;
+        c.index = std::strtoll(f[0].c_str(), NULL, 10);
+        c.size = std::strtoull(f[1].c_str(), NULL, 10);
+        c.crc = (uint32_t)std::strtoul(f[2].c_str(), NULL, 16);
+        c.offset = 0;
+        frames.push_back(c);
+    }
+    std::map<int64_t, uint32_t> storedCrcs; // Y4M only, the other containers store encoded frames
+    const std::string avi = firstMatch(result.dir, "trial", ".avi");
+    const std::string y4m = firstMatch(result.dir, "trial", ".y4m");
+    if (!avi.empty() || !y4m.empty()) {
+        std::vector<VideoFrame> stored;
+        if (!avi.empty()) {
+            const std::vector<std::string> segments(aviSegments(avi));
+            result.container = segments.size() > 1 ? "avi, " + Tools::toString(segments.size()) + " segments" : "avi";
+            for (size_t i = 0; i < segments.size(); ++i) {
+                if (!readAviFrames(segments[i], stored)) {
+                    result.problems.push_back(fs::path(segments[i]).filename().string() + " has no idx1, frames located from its frame table");
+                }
+            }
+        } else {
+            result.container = "y4m";
+            size_t width, height;
+            stored = readY4mFrames(y4m, width, height);
+            for (size_t i = 0; i < frames.size(); ++i) {
+                storedCrcs[frames[i].index] = frames[i].crc;
+            }
+        }
+        if (stored.size() != frames.size()) {
+            result.problems.push_back(Tools::toString(stored.size()) + " frames in the " + result.container + " file for " + Tools::toString(frames.size()) + " checksums");
+        }
+        for (size_t i = 0; i < frames.size() && i < stored.size(); ++i) {
+            frames[i].file = stored[i].file;
+            frames[i].offset = stored[i].offset;
+        }
+        frames.resize(std::min(frames.size(), stored.size()));
+    } else {
+        result.container = "jpeg";
+        std::map<int64_t, fs::path> files;
+        for (fs::directory_iterator it(result.dir); it != fs::directory_iterator(); ++it) {
+            const std::string name(it->path().filename().string());
+            if (name.find("frame.") == 0 && it->path().extension() == ".jpeg") {
+                files[std::strtoll(name.c_str() + 6, NULL, 10)] = it->path();
+            }
+        }
+        std::vector<FrameCheck> present;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (!files.count(frames[i].index)) {
+                ++result.badFrames;
+                result.problems.push_back("frame " + Tools::toString(frames[i].index) + " is missing");
+                continue;
+            }
+            frames[i].file = files[frames[i].index];
+            present.push_back(frames[i]);
+        }
+        frames.swap(present);
+    }
+    checkRows(result, frames.size() + result.badFrames, storedCrcs);
+    checks.insert(checks.end(), frames.begin(), frames.end());
+}
+
+void verify() {
+    const fs::path inputRoot(Tools::getOption("input", "D:/cameraOutput"));
+    unsigned int jobsCount = std::atoi(Tools::getOption("jobs", "0").c_str());
+    if (jobsCount == 0) {
+        jobsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<TrialResult> trials;
+    for (fs::recursive_directory_iterator it(inputRoot); it != fs::recursive_directory_iterator(); ++it) {
+        const std::string name(it->path().filename().string());
+        if (name.find("checksums_trial") == 0 && it->path().extension() == ".csv") {
+            TrialResult r;
+            r.dir = it->path().parent_path();
+            r.frames = r.bytes = r.badFrames = r.rows = r.badRows = 0;
+            trials.push_back(r);
+        }
+    }
+    std::sort(trials.begin(), trials.end(), [](const TrialResult &a, const TrialResult &b) { return a.dir < b.dir; });
+    std::vector<FrameCheck> checks;
+    for (size_t i = 0; i < trials.size(); ++i) {
+        try {
+            planTrial(i, trials[i], checks);
+        }
+        catch (const std::exception &e) {
+            trials[i].problems.push_back(e.what());
+        }
+    }
+    Tools::log("Verifying " + Tools::toString(checks.size()) + " frames of " + Tools::toString(trials.size()) + " trials with " + Tools::toString(jobsCount) + " workers, CRC32C " + (crc32cAccelerated() ? "hardware" : "table"));
+
+    // frames are taken in file order, a few at a time, so each worker reads long runs of one file
+    const size_t batch = 16;
+    std::atomic<size_t> next(0);
+    std::mutex lock;
+    const uint64_t start = Tools::getTimestamp();
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < jobsCount; ++w) {
+        workers.push_back(std::thread([&]() {
+            std::vector<uint8_t> buf;
+            std::ifstream in;
+            fs::path opened;
+            for (size_t first = next.fetch_add(batch); first < checks.size(); first = next.fetch_add(batch)) {
+                for (size_t i = first; i < std::min(first + batch, checks.size()); ++i) {
+                    const FrameCheck &c = checks[i];
+                    if (c.file != opened) {
+                        in.close();
+                        in.clear();
+                        in.open(c.file, std::ios::binary);
+                        opened = c.file;
+                    }
+                    buf.resize(c.size);
+                    in.seekg(c.offset);
+                    const bool complete = (bool)in.read((char *)buf.data(), c.size);
+                    in.clear();
+                    const bool good = complete && crc32c(0, buf.data(), c.size) == c.crc;
+                    std::unique_lock<std::mutex> guard(lock);
+                    TrialResult &r = trials[c.trial];
+                    ++r.frames;
+                    r.bytes += c.size;
+                    if (!good) {
+                        ++r.badFrames;
+                        if (r.badFrames <= 10) {
+                            r.problems.push_back("frame " + Tools::toString(c.index) + (complete ? " does not match its CRC" : " is truncated"));
+                        }
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    const double seconds = std::max(1e-6, (Tools::getTimestamp() - start) / 1e6);
+    uint64_t bytes = 0;
+    unsigned int failed = 0;
+    for (size_t i = 0; i < trials.size(); ++i) {
+        const TrialResult &r = trials[i];
+        bytes += r.bytes;
+        const bool ok = r.problems.empty() && r.badFrames == 0 && r.badRows == 0;
+        failed += ok ? 0 : 1;
+        Tools::log(r.dir.string() + " (" + r.container + "): " + Tools::toString(r.frames) + " frames, " + Tools::toString(r.rows) + " rows, "
+                   + (ok ? "OK" : Tools::toString(r.badFrames) + " bad frames, " + Tools::toString(r.badRows) + " bad rows"));
+        for (size_t k = 0; k < r.problems.size(); ++k) {
+            Tools::log("  " + r.problems[k]);
+        }
+    }
+    std::stringstream ss;
+    ss << bytes / 1e6 << " MB checked in " << seconds << " s, " << bytes / seconds / 1e6 << " MB/s";
+    Tools::log(ss.str());
+    if (failed) {
+        throw std::runtime_error(Tools::toString(failed) + " of " + Tools::toString(trials.size()) + " trials failed verification");
+    }
+}
+
+} // anonymous
+
+static Tools::Sample addSample(__FILE__, verify,
+    "Check every saved frame and CSV row under --input (default D:/cameraOutput) against its CRC32C\n"
+    "options: --jobs <n>\n"
+    "reads checksums_trialN.csv of each trial and the JPEG files, AVI or Y4M it describes");
@@ -1,245 +1,821 @@
-/**
- * @file trial.cpp
- * @author Ori Garibi & Tian Lan
- * @brief 
- * @version 0.1
- * @date 2022-07-07
- * 
- * @copyright Copyright (c) 2022
- * 
- */
-#include "tools/tools.h"
-#include <D:\Euresys\eGrabber\include\EGrabber.h>
-#include <D:\Euresys\eGrabber\include\FormatConverter.h>
-#include <iostream>
-#include <direct.h>
-#include <string>
-#include <fstream>
-#include "DoublyLinkedList.h"
-#include "Record.h"
-
-using namespace Euresys;     
-using namespace std;
-
-class MyGrabber : public EGrabber<CallbackOnDemand> {
-    public:
-        MyGrabber(EGenTL &gentl, int id, int trial, int numBuf, int bufferSize) : EGrabber<CallbackOnDemand>(gentl, id/2, id%2) { //initializing grabber class to set each grabber setting
-            
-            execute<DeviceModule>("DeviceReset");
-            if (id == 0) //master grabber
-            {
-                execute<RemoteModule>("AcquisitionStop");   // in case we stop before the end
-                setString<DeviceModule>("CameraControlMethod", "RC");  //master grabber set to RC, the rest set to NC
-                setString<DeviceModule>("ExposureReadoutOverlap", "True"); 
-                setString<InterfaceModule>("EventSelector", "LIN8");
-                setInteger<InterfaceModule>("EventNotification", true);
-                setString<InterfaceModule>("LineSelector", "TTLIO11");
-                setString<InterfaceModule>("LineMode", "Input");
-                setString<InterfaceModule>("LineInputToolSelector", "LIN8");
-                setString<InterfaceModule>("LineInputToolSource", "TTLIO11");
-                setString<InterfaceModule>("LineInputToolActivation", "RisingEdge");
-                setString<InterfaceModule>("LineFilterStrength", "Highest"); //set trigger strength filter
-                    
-                setString<RemoteModule>("TriggerMode", "TriggerModeOn");
-                setString<RemoteModule>("TriggerSource", "SWTRIGGER");
-        
-                setString<RemoteModule>("Banks", "Banks_ABCD");
-                setFloat<DeviceModule>("CycleMinimumPeriod",1000.0); // unit is uS. = 10e6/FPS
-
-                const int fps = 1000;
-
-                //setInteger<RemoteModule>("AcquisitionFrameRate", fps);
-                setFloat<RemoteModule>("ExposureTime", 9e6/(fps*10)); //convert exposure time to 9e6/(fps*10)
-                enableEvent<IoToolboxData>();             
-            }
-
-            setString<StreamModule>("StripeArrangement", "Geometry_1X_2YM");
-            setInteger<StreamModule>("LineWidth", 2560);
-            setInteger<StreamModule>("LinePitch", 2560);
-            setInteger<StreamModule>("StripeHeight", 4);
-            setInteger<StreamModule>("StripePitch", 4);
-            setInteger<StreamModule>("BlockHeight", 4);
-            setInteger<StreamModule>("BufferPartCount", bufferSize);
-            setInteger<StreamModule>("StripeOffset", 0);
-
-            int listSize = numBuf*bufferSize;
-
-            reallocBuffers(numBuf); //reallocate buffers for each grabber
-        }
-
-    private:
-        virtual void onIoToolboxEvent(const IoToolboxData &data) { //method to priunt data for specific frames
-            std::cout << "timestamp: " << std::dec << data.timestamp << " us, "
-                      << "numid: 0x" << std::hex << data.numid                  
-                      << " (" << getEventDescription(data.numid) << "), "
-                      << "Context1: " << data.context1 << ", "
-                      << "Context2: " << data.context2 << ","
-                      << std::endl;
-        }
-};
-
-
-ofstream openFile(int trialCount){ //opens CSV file and inserts header
-    ofstream timer;
-    timer.open("D:/cameraOutput/Trial"+to_string(trialCount)+"/timeStamps_trial"+to_string(trialCount)+".csv");
-    timer<<"Image Index"<<","<<"Timestamp(in microseconds)"<<","<<"Trigger"<<"\n";
-    return timer;
-}
-void fileProcessor(ofstream &file, Record rec, int realIndex){ //prints data to CSV, data includes index, timestamp, and trigger
-    file<<realIndex<<","<<rec.timeStamp<<","<<rec.trig<<"\n";
-}
-static void sample(int trialCount, int trial, int numBuf, int bufferSize, double concentration){
-    DoublyLinkedList<uint8_t *> *imagePointer[4]; //DLL that stores image pointers for each grabber
-    DoublyLinkedList<Record> *records = new DoublyLinkedList<Record>(); //DLL that stores image records
-    for (int i =0; i<4; i++)
-    {
-        imagePointer[i] = new DoublyLinkedList<uint8_t *>();
-    }
-
-    
-    IoToolboxData data;
-    const int listSize = numBuf*bufferSize;
-    ofstream timer = openFile(trialCount); //open file
-    EGenTL genTL; // load GenTL producer
-    MyGrabber* grabber[4]; //select the four grabbers
-
-    for (int i=0; i<4; i++)
-    {
-        grabber[i] = new MyGrabber(genTL,i, trial, numBuf, bufferSize); // create grabber
-    }
-
-    for ( int i=3; i>-1; i--)
-    {
-        grabber[i]->start(); //start the four grabbers
-    }
-
-    FormatConverter converter(genTL); // create rgb converter environment
-    //int i = 0;
-    bool trig = false;
-    int numTrig = grabber[0]->getInteger<InterfaceModule>("EventCount[LIN8]");
-    int halfList = listSize*concentration;
-    bool stopCheck = false;
-    for (size_t frame=0;frame < listSize; ++frame) { //start taking images
-        if(frame >= halfList && stopCheck == false){ //if the concentration of the images have been taken and no trigger has been detected clear the back of the DLL for images and records
-            for (int i=0; i <4; i++)
-            {
-                imagePointer[i]->removeBack();
-            }
-            records->removeBack();
-            --frame; //go back a frame
-            stringstream msg;
-            imagePointer[0]->getSize();
-            msg << "remove back "  << frame << " current size " <<imagePointer[0]->getSize();
-            genTL.memento(msg.str());
-        }
-        trig = false;
-        cout<<"Grabbing frame "<<frame<<endl;
-
-        ScopedBuffer b0(*grabber[0]); // wait and get a buffer
-        ScopedBuffer b1(*grabber[1]); // wait and get a buffer
-        ScopedBuffer b2(*grabber[2]); // wait and get a buffer
-        ScopedBuffer b3(*grabber[3]); // wait and get a buffer
-
-        const size_t imgSize = b0.getInfo<size_t>(gc::BUFFER_INFO_SIZE);
-
-        imagePointer[0]->insertFront(b0.getInfo<uint8_t *>(gc::BUFFER_INFO_BASE)); // + (frame%bufferSize)*imgSize/bufferSize); //grab images for each grabber
-        imagePointer[1]->insertFront(b1.getInfo<uint8_t *>(gc::BUFFER_INFO_BASE)); // + (frame%bufferSize)*imgSize/bufferSize);
-        imagePointer[2]->insertFront(b2.getInfo<uint8_t *>(gc::BUFFER_INFO_BASE)); //+ (frame%bufferSize)*imgSize/bufferSize);
-        imagePointer[3]->insertFront(b3.getInfo<uint8_t *>(gc::BUFFER_INFO_BASE)); // + (frame%bufferSize)*imgSize/bufferSize);
-        
-        uint64_t t0 = b0.getInfo<uint64_t>(gc::BUFFER_INFO_TIMESTAMP); //get each grabber's timestamp
-        uint64_t t1 = b1.getInfo<uint64_t>(gc::BUFFER_INFO_TIMESTAMP);
-        uint64_t t2 = b2.getInfo<uint64_t>(gc::BUFFER_INFO_TIMESTAMP);
-        uint64_t t3 = b3.getInfo<uint64_t>(gc::BUFFER_INFO_TIMESTAMP);
-
-        if(grabber[0]->getInteger<InterfaceModule>("EventCount[LIN8]") > numTrig && frame+1 >= halfList && stopCheck == false){ //trigger bools
-            trig = true;
-            stopCheck = true;
-            genTL.memento("got trigger");
-        }
-        uint64_t tavg = (t0+t1+t2+t3)/4; //averave each grabber's timestamp
-        Record record = Record(frame, tavg, trig);
-        records->insertFront(record); //insert image record to list
-    }
-    
-    stringstream msg;
-    msg << "finish recording, list size is " << imagePointer[0]->getSize();
-    genTL.memento(msg.str());
-    for (int i=0; i<4; i++)
-    {
-        grabber[i]->stop();
-    }
-    const std::string format (grabber[0]->getPixelFormat()); //save image formats
-    const size_t width = grabber[0]->getWidth();
-    const size_t height = grabber[0]->getHeight();
-    const size_t imgPitch = grabber[0]->getInteger<StreamModule>("LinePitch");
-    const size_t imgSize = height*imgPitch;
-
-    uint8_t * des = (uint8_t*) malloc (imgSize*4); //allocate destination memory for images
-    for (size_t frames=0; frames<listSize; ++frames) { //begin saving
-        cout<<"Saving frame "<<frames<<" to disk "<<endl;
-        uint8_t* t[4];
-        t[0]= imagePointer[0]->removeBack(); //remove each frame from the back of the DLL
-        t[1]= imagePointer[1]->removeBack();
-        t[2]= imagePointer[2]->removeBack();
-        t[3]= imagePointer[3]->removeBack();
-        uint8_t * tmp = des;
-        for (int  j=0; j <  bufferSize; j++) //do this for each buffer part
-        {
-            for (int i=0; i<height/4; i++)            // top part loop through the whole image , each time copying 4 (subimages) *2 = 8 lines 
-            {
-                for (int j=3; j>-1; j--)               // loops through the 4 sub image 
-                {
-                    memcpy(tmp,t[j],imgPitch*2);        // copy 2 lines from sub image j to current location of the pointer
-                    tmp +=  imgPitch*2;                 // move pointer forward by 2 lines
-                    t[j] += imgPitch*2;                 // move in the sub image the current pointer
-                }
-            }       
-            
-            for (int i=height/4; i<height/2; i++)      // bottom part loop through the whole image , each time copying 4 ( subimages) *2 = 8 lines 
-            {
-                for (int j=0; j<4; j++)                // loops through the 4 sub image 
-                {
-                    memcpy(tmp,t[j],imgPitch*2);        // copy 2 lines from sub image j to current location of the pointer
-                    tmp += imgPitch*2;                   // move pointer forward by 2 lines
-                    t[j] += imgPitch*2;                 // move in the sub image the current pointer
-                }
-            }
-
-            stringstream msg;
-            msg << "save image, remaining " << imagePointer[0]->getSize();
-            genTL.memento(msg.str());
-            FormatConverter::Auto bgr(converter, FormatConverter::OutputFormat("RGB8"), des, format, width,  height * 4 * bufferSize, imgSize *4 *bufferSize, imgPitch);
-                bgr.saveToDisk("D:/cameraOutput/Trial"+to_string(trialCount)+"/frame.NNN.jpeg", frames * bufferSize +j); //save stitched images
-            fileProcessor(timer, records->removeBack(), frames * bufferSize +j); //assign index and write image data
-            t[0] += imgSize; //iterate to next buffer part
-            t[1] += imgSize;
-            t[2] += imgSize;
-            t[3] += imgSize;
-        }
-    }
-    free(des);
-    timer.close(); //close file
-    for (int i=0; i<4; i++)
-    {
-        delete(grabber[i]);
-        delete(imagePointer[i]);
-    }
-    genTL.memento("delete grabbers");
-    delete (records);
-}
-
-
-int main(){
-    //make it possible to change the before after ammount of images
-    int numTrials = 5;
-    int numBuf = 600;
-    int bufferSize = 1;
-    double concentration = 0.5;
-    for(int trialCount = 1; trialCount <= numTrials; ++trialCount){ //run for certain ammount of trials
-        string temp = "D:/cameraOutput/Trial" + to_string(trialCount); //create directory for images and files
-        mkdir(temp.c_str());
-        sample(trialCount, trialCount, numBuf, bufferSize, concentration);
-    }
-    return 0;
-}
\ No newline at end of file
+/**
+ * @file trial.cpp
+ * @author Ori Garibi & Tian Lan
+ * @brief 
+ * @version 0.1
+ * @date 2022-07-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "tools/tools.h"
+#include <D:\Euresys\eGrabber\include\EGrabber.h>
+#include <D:\Euresys\eGrabber\include\FormatConverter.h>
+#include <iostream>
+#include <direct.h>
+#include <string>
+#include <fstream>
+#include "DoublyLinkedList.h"
+#include "Record.h"
+#include "MotionEnergy.h"
+#include "Preview.h"
+#include "FileWriter.h"
+#include "Spool.h"
+#include "JpegEncoder.h"
+#include "ClockSync.h"
+#include "DeviceProfile.h"
+#include "Topology.h"
+#include "StreamMonitor.h"
+#include "VideoWriter.h"
+#include "Crc32c.h"
+#include "Trace.h"
+#include "FrameHistory.h"
+#include "PartTuner.h"
+#include "StimulusScheduler.h"
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+
+using namespace Euresys;     
+using namespace std;
+
+const int FPS = 1000;
+
+struct TrialSettings{ //acquisition and output settings shared by every camera
+    int numBuf; //announced buffers at bufferSize frames per buffer, scaled when the part count changes so the frames held stay the same
+    int bufferSize; //frames per buffer (BufferPartCount)
+    bool tuneParts; //pick bufferSize for the next trial from the per-buffer overhead of the last one
+    int maxPartLatency; //us of frames one buffer may hold, a trigger is checked once per buffer
+    double concentration;
+    int previewScale;
+    int spoolFrames;
+    int exportBefore; //frames saved before the reaction onset, with exportAfter; both 0 saves every recorded frame
+    int exportAfter; //frames saved after the reaction onset
+    int historyFrames; //buffers kept compressed in RAM, 0 keeps the history in the grabber buffers only
+    int historyMB; //RAM of the compressed history
+    int jpegQuality;
+    int jpegSubsampling;
+    bool jpegGrayscale; //one channel JPEGs for Mono8, smaller but not the RGB files downstream tools expect
+    bool jpegFastDct; //TJFLAG_FASTDCT, faster encode at a small quality cost
+    int encoderThreads;
+    unsigned int overrunPolicy; //OverrunPolicy flags
+    unsigned int monitorEvery; //frames between two samples of the stream counters
+    VideoOutput output; //one file per frame or one video file per trial
+    bool trace; //record a timeline of the trial into TrialN/trace_trialN.json
+    bool scheduleStimulus; //run the camera start and stimulus commands of each trial on the stimulus scheduler
+    bool softwareStart; //start the camera with TriggerSoftware at cameraStartDelay instead of at grabber start
+    string stimulusLine; //master output line driven by the stimulus pulse, empty for none
+    int64_t cameraStartDelay; //us after the grabbers have started
+    int64_t stimulusDelay; //us after the camera start
+    int64_t stimulusPulse; //us the stimulus line stays high
+    int64_t trialPeriod; //us between trial starts, 0 runs the trials back to back
+};
+
+DeviceProfile grabberProfile(const CameraTopology &camera, int index, int bufferSize, const string &stimulusLine){ //settings of each grabber, in the order they must be written
+    DeviceProfile profile;
+    if (index == camera.master) //master grabber
+    {
+        profile.addString(PROFILE_DEVICE, "CameraControlMethod", "RC");  //master grabber set to RC, the rest set to NC
+        profile.addString(PROFILE_DEVICE, "ExposureReadoutOverlap", "True"); 
+        profile.addString(PROFILE_INTERFACE, "EventSelector", "LIN8", true);
+        profile.addInteger(PROFILE_INTERFACE, "EventNotification", true);
+        profile.addString(PROFILE_INTERFACE, "LineSelector", "TTLIO11", true);
+        profile.addString(PROFILE_INTERFACE, "LineMode", "Input");
+        profile.addString(PROFILE_INTERFACE, "LineInputToolSelector", "LIN8", true);
+        profile.addString(PROFILE_INTERFACE, "LineInputToolSource", "TTLIO11");
+        profile.addString(PROFILE_INTERFACE, "LineInputToolActivation", "RisingEdge");
+        profile.addString(PROFILE_INTERFACE, "LineFilterStrength", "Highest"); //set trigger strength filter
+        if(!stimulusLine.empty()){ //stimulus pulse driven by the scheduler through UserOutput0
+            profile.addString(PROFILE_INTERFACE, "LineSelector", stimulusLine, true);
+            profile.addString(PROFILE_INTERFACE, "LineMode", "Output");
+            profile.addString(PROFILE_INTERFACE, "LineSource", "UserOutput0");
+        }
+            
+        profile.addString(PROFILE_REMOTE, "TriggerMode", "TriggerModeOn");
+        profile.addString(PROFILE_REMOTE, "TriggerSource", "SWTRIGGER");
+
+        profile.addString(PROFILE_REMOTE, "Banks", "Banks_ABCD");
+        profile.addFloat(PROFILE_DEVICE, "CycleMinimumPeriod",1000.0); // unit is uS. = 10e6/FPS
+
+        //profile.addInteger(PROFILE_REMOTE, "AcquisitionFrameRate", FPS);
+        profile.addFloat(PROFILE_REMOTE, "ExposureTime", 9e6/(FPS*10)); //convert exposure time to 9e6/(fps*10)
+    }
+
+    profile.addString(PROFILE_STREAM, "StripeArrangement", camera.stripeArrangement);
+    profile.addInteger(PROFILE_STREAM, "LineWidth", camera.lineWidth);
+    profile.addInteger(PROFILE_STREAM, "LinePitch", camera.linePitch);
+    profile.addInteger(PROFILE_STREAM, "StripeHeight", camera.stripeHeight);
+    profile.addInteger(PROFILE_STREAM, "StripePitch", camera.stripePitch);
+    profile.addInteger(PROFILE_STREAM, "BlockHeight", camera.blockHeight);
+    profile.addInteger(PROFILE_STREAM, "BufferPartCount", bufferSize);
+    profile.addInteger(PROFILE_STREAM, "StripeOffset", camera.stripeOffset);
+    return profile;
+}
+
+class MyGrabber : public EGrabber<CallbackOnDemand> {
+    public:
+        MyGrabber(EGenTL &gentl, const CameraTopology &camera, int index, int numBuf, int bufferSize, const string &stimulusLine) : EGrabber<CallbackOnDemand>(gentl, camera.grabbers[index].interfaceIndex, camera.grabbers[index].deviceIndex) { //initializing grabber class to set each grabber setting
+            uint64_t start = Tools::getTimestamp();
+            const bool master = index == camera.master;
+            DeviceProfile profile = grabberProfile(camera, index, bufferSize, stimulusLine);
+            const string cache = "D:/cameraOutput/grabber"+to_string(camera.grabbers[index].interfaceIndex)+"_"+to_string(camera.grabbers[index].deviceIndex)+".profile"; //profile applied by the last successful configuration
+            warmStart = profile.matchesFile(cache);
+            if(warmStart){ //same settings as last time, only rewrite what drifted
+                try {
+                    if (master)
+                    {
+                        execute<RemoteModule>("AcquisitionStop");   // in case we stop before the end
+                    }
+                    configWrites = profile.apply(*this, true);
+                }
+                catch (const std::exception &) { //device state not what we expect, start over
+                    warmStart = false;
+                }
+            }
+            if(!warmStart){
+                execute<DeviceModule>("DeviceReset");
+                if (master)
+                {
+                    execute<RemoteModule>("AcquisitionStop");   // in case we stop before the end
+                }
+                configWrites = profile.apply(*this, false);
+            }
+            if (master) //master grabber
+            {
+                enableEvent<IoToolboxData>();             
+            }
+
+            reallocBuffers(numBuf); //reallocate buffers for each grabber
+            profile.save(cache);
+            configTime = Tools::getTimestamp() - start;
+            eventSeen = false;
+            eventTime = 0;
+        }
+        bool warmStart; //configured without DeviceReset
+        unsigned int configWrites; //feature writes done by the constructor
+        uint64_t configTime; //constructor duration (us)
+        bool eventSeen; //set by onIoToolboxEvent, eventTime is in the interface clock (us)
+        uint64_t eventTime;
+
+    private:
+        virtual void onIoToolboxEvent(const IoToolboxData &data) { //method to priunt data for specific frames
+            Trace::instance().instant("IoToolbox", "event", "numid", data.numid, "timestamp", data.timestamp);
+            eventSeen = true;
+            eventTime = data.timestamp;
+            std::cout << "timestamp: " << std::dec << data.timestamp << " us, "
+                      << "numid: 0x" << std::hex << data.numid                  
+                      << " (" << getEventDescription(data.numid) << "), "
+                      << "Context1: " << data.context1 << ", "
+                      << "Context2: " << data.context2 << ","
+                      << std::endl;
+        }
+};
+
+
+string trialDir(int trialCount, const CameraTopology &camera){ //output directory of one camera for one trial
+    string dir = "D:/cameraOutput/Trial"+to_string(trialCount);
+    if(!camera.name.empty()){
+        dir += "/"+camera.name;
+    }
+    return dir;
+}
+string spoolPath(const CameraTopology &camera){ //disk ring of one camera, reused by every trial
+    return "D:/cameraOutput/spool"+camera.name+".bin";
+}
+unique_ptr<TextSink> openFile(int trialCount, const CameraTopology &camera, FileWriter &writer){ //opens CSV file and inserts header
+    unique_ptr<TextSink> timer(new TextSink(writer, trialDir(trialCount, camera)+"/timeStamps_trial"+to_string(trialCount)+".csv"));
+    stringstream header;
+    header<<"Image Index"<<","<<"Timestamp(in microseconds)"<<","<<"Trigger"<<","<<"Motion Energy"<<","<<"Host Timestamp(in microseconds)"<<","<<"Grabber Skew(in microseconds)"<<","<<"Stimulus Host Timestamp(in microseconds)"<<","<<"Frame CRC32C"<<","<<"Row CRC32C"<<"\n";
+    timer->write(header.str());
+    return timer;
+}
+void fileProcessor(TextSink &file, Record rec, int realIndex, uint32_t frameCrc){ //prints data to CSV, data includes index, timestamp, and trigger
+    stringstream row;
+    row<<realIndex<<","<<rec.timeStamp<<","<<rec.trig<<","<<rec.motion<<","<<rec.hostTimeStamp<<","<<rec.skew<<","<<rec.stimulusTime<<","<<crc32cHex(frameCrc);
+    const string text = row.str();
+    file.write(text+","+crc32cHex(crc32c(0, (const uint8_t *)text.data(), text.size()))+"\n"); //last column covers the row before it
+}
+/**
+ * @brief stitch one frame from the sub-images of every grabber of a camera
+ *
+ * @param des destination, numGrabbers*height lines
+ * @param t current position in each sub-image, advanced by one sub-image
+ * @param camera stripe geometry
+ * @param height lines per sub-image
+ * @param imgPitch bytes per line
+ * @param lineBytes bytes of each line covered by the CRC, the pixels without the pitch padding as Y4M stores them
+ * @param preview optional preview fed with each band of stitched lines
+ * @return uint32_t CRC32C of the stitched frame, computed while the lines are still in cache
+ */
+uint32_t stitch(uint8_t *des, vector<uint8_t *> &t, const CameraTopology &camera, size_t height, size_t imgPitch, size_t lineBytes, Preview *preview){
+    const int n = t.size();
+    const size_t band = imgPitch*camera.stripeLines; //lines copied from one grabber at a time
+    const size_t rounds = height/camera.stripeLines; //bands per sub-image
+    uint8_t *tmp = des;
+    uint32_t crc = 0;
+    uint8_t *unchecked = des; //stitched lines not in the CRC yet, added in runs that are still in L2
+    for (size_t i=0; i<rounds; i++)            // each round copies one band from every sub image
+    {
+        uint8_t *lines = tmp;
+        const bool reverse = camera.mirrored && i < rounds/2; //top part stacks the sub images in reverse order
+        for (int k=0; k<n; k++)               // loops through the sub images
+        {
+            const int j = reverse ? n-1-k : k;
+            memcpy(tmp,t[j],band);        // copy a band from sub image j to current location of the pointer
+            tmp += band;                 // move pointer forward by one band
+            t[j] += band;                 // move in the sub image the current pointer
+        }
+        if(preview){
+            preview->addRows(lines, imgPitch, n*camera.stripeLines); // downscale the lines while they are still in cache
+        }
+        if(lineBytes < imgPitch){ //line by line, skipping the padding
+            for (uint8_t *line = lines; line < tmp; line += imgPitch)
+            {
+                crc = crc32c(crc, line, lineBytes);
+            }
+        }
+        else if(tmp - unchecked >= 256*1024 || i+1 == rounds){
+            crc = crc32c(crc, unchecked, tmp - unchecked);
+            unchecked = tmp;
+        }
+    }
+    return crc;
+}
+static void sample(int trialCount, EGenTL &genTL, const CameraTopology &camera, const TrialSettings &settings, int bufferSize, PartTuner &tuner, double spoolRate){
+    Trace::instance().nameThread("pipeline "+(camera.name.empty() ? string("camera") : camera.name));
+    const int n = camera.grabbers.size();
+    const int m = camera.master;
+    const int numBuf = max(4, settings.numBuf*settings.bufferSize/bufferSize); //same frames in the ring whatever the part count
+    const int spoolSlots = settings.spoolFrames/bufferSize; //one buffer per slot
+    const int historyBuffers = settings.historyFrames/bufferSize;
+    //everything below is owned by unique_ptr so a throw anywhere in the trial closes the grabbers and files before the next trial
+    vector<unique_ptr<DoublyLinkedList<uint8_t *> > > imagePointer(n); //DLL that stores image pointers for each grabber
+    unique_ptr<DoublyLinkedList<Record> > records(new DoublyLinkedList<Record>()); //DLL that stores image records
+    for (int i =0; i<n; i++)
+    {
+        imagePointer[i].reset(new DoublyLinkedList<uint8_t *>());
+    }
+
+    
+    const int listSize = spoolSlots > 0 ? spoolSlots : historyBuffers > 0 ? historyBuffers : numBuf; //buffers; with a spool or a compressed history the history is bounded by the disk or RAM, not by the announced buffers
+    vector<unique_ptr<MyGrabber> > grabbers(n); //the grabbers of this camera, destroyed after everything that reads their buffers
+    vector<MyGrabber *> grabber(n);
+
+    for (int i=0; i<n; i++)
+    {
+        grabbers[i].reset(new MyGrabber(genTL, camera, i, numBuf, bufferSize, settings.scheduleStimulus ? settings.stimulusLine : "")); // create grabber, the line is left alone unless the scheduler drives it
+        grabber[i] = grabbers[i].get();
+        cout<<"Grabber "<<camera.name<<i<<" configured in "<<grabber[i]->configTime/1000.0<<" ms ("<<(grabber[i]->warmStart ? "warm" : "reset")<<", "<<grabber[i]->configWrites<<" writes)"<<endl;
+    }
+
+    if(settings.output == OUTPUT_Y4M && grabber[m]->getPixelFormat() != "Mono8"){ //checked before recording, the trial would be lost at save time
+        throw runtime_error("Y4M output needs Mono8 frames, not "+grabber[m]->getPixelFormat());
+    }
+
+    const size_t partBytes = grabber[m]->getHeight()*grabber[m]->getInteger<StreamModule>("LinePitch"); //bytes of one frame of one grabber
+    const size_t bufBytes = partBytes*bufferSize; //bytes of one buffer of one grabber
+    unique_ptr<FileWriter> writer(createFileWriter()); //io_uring where available, thread pool otherwise
+    unique_ptr<TextSink> timer = openFile(trialCount, camera, *writer); //open file
+    unique_ptr<Spool> spool;
+    unique_ptr<FrameHistory> history;
+    unique_ptr<DoublyLinkedList<int> > slots; //spool slot or history sequence number of each record
+    if(spoolSlots > 0){
+        spool.reset(new Spool(spoolPath(camera), bufBytes*n, spoolSlots, *writer));
+        slots.reset(new DoublyLinkedList<int>());
+        const double rate = spoolRate; //measured once in main
+        double needed = (double)spool->getSlotSize()*FPS/bufferSize;
+        stringstream msg;
+        msg << "spool write rate (" << writer->getName() << ") " << rate/1e6 << " MB/s, needed " << needed/1e6 << " MB/s";
+        genTL.memento(msg.str());
+        if(rate > 0 && rate < needed){ //0 when the benchmark failed
+            cout<<"WARNING: spool disk cannot keep up with "<<FPS<<" fps ("<<rate/1e6<<" MB/s of "<<needed/1e6<<" MB/s), acquisition will stall"<<endl;
+        }
+    }
+    else if(historyBuffers > 0){
+        history.reset(new FrameHistory(n, bufBytes, max(1, numBuf/2), settings.encoderThreads)); //compressed while the grabber buffers are still in the ring
+        slots.reset(new DoublyLinkedList<int>());
+        genTL.memento("frame history: "+history->getCodec());
+    }
+
+    for ( int i=n-1; i>-1; i--)
+    {
+        if(i != m){
+            grabber[i]->start(); //start the slave grabbers first
+        }
+    }
+    grabber[m]->start(); //the master starts the camera
+    unique_ptr<StimulusScheduler> scheduler; //camera start and stimulus at fixed times from here, the same in every trial; stopped however sample() is left
+    if(settings.scheduleStimulus){
+        scheduler.reset(new StimulusScheduler());
+        MyGrabber *master = grabber[m];
+        if(settings.softwareStart){
+            scheduler->add("camera start", settings.cameraStartDelay, [master]{ master->execute<RemoteModule>("TriggerSoftware"); });
+        }
+        if(!settings.stimulusLine.empty()){
+            master->setString<InterfaceModule>("UserOutputSelector", "UserOutput0"); //selected once, each fire is a single write
+            master->setString<InterfaceModule>("UserOutputValue", "False"); //low before the first pulse, even after an aborted run
+            scheduler->add("stimulus on", settings.cameraStartDelay + settings.stimulusDelay, [master]{ master->setString<InterfaceModule>("UserOutputValue", "True"); });
+            //the line must not stay high: stop() drops it when the recording ends or throws before this fires
+            scheduler->addCleanup("stimulus off", settings.cameraStartDelay + settings.stimulusDelay + settings.stimulusPulse, [master]{ master->setString<InterfaceModule>("UserOutputValue", "False"); });
+        }
+        scheduler->start(Tools::getTimestampNs());
+    }
+
+    //int i = 0;
+    bool trig = false;
+    int numTrig = grabber[m]->getInteger<InterfaceModule>("EventCount[LIN8]");
+    int halfList = listSize*settings.concentration;
+    const uint64_t historyBudget = (uint64_t)settings.historyMB << 20;
+    bool historyFull = false; //pre-trigger part of the history has used its share of the RAM
+    bool stopCheck = false;
+    MotionEnergy energy(grabber[m]->getWidth(), grabber[m]->getHeight(), grabber[m]->getInteger<StreamModule>("LinePitch")); //coarse grid frame difference of each sub-image
+    ReactionOnset onset;
+    vector<uint8_t *> prev(n, (uint8_t *)NULL); //previous frame of each grabber
+    unsigned int seq = 0; //buffers grabbed so far, numbers the spool slots
+    ClockSync clocks(n); //grabber clocks fitted against the host clock
+    vector<PartClock> partClocks(n, PartClock(bufferSize, FPS)); //timestamp of each frame of a buffer
+    vector<uint64_t> motion(bufferSize);
+    deque<vector<unique_ptr<ScopedBuffer> > > held; //buffers the history workers still read, oldest first
+    unsigned int heldFirst = 0; //sequence number of held.front()
+    deque<uint64_t> fires; //stimulus fire times not yet placed on a frame
+    bool eventPending = false; //trigger event seen, its first frame is not grabbed yet
+    uint64_t eventTime = 0; //of the pending trigger event, in the master clock
+    StreamMonitor monitor(n, settings.overrunPolicy, settings.monitorEvery); //queue depth and lost frames of every grabber
+    monitor.start(grabber); //frames lost before the first sample count too
+    for (size_t frame=0;frame < listSize; ++frame) { //start taking images
+        if(history && stopCheck == false && frame > 0 && history->getBytes() > historyBudget*settings.concentration){ //static scenes fit more frames than halfList, busy ones fewer
+            historyFull = true;
+        }
+        if((frame >= halfList || historyFull) && stopCheck == false){ //if the concentration of the images have been taken and no trigger has been detected clear the back of the DLL for images and records
+            for (int k=0; k<bufferSize; k++) //every frame of the oldest buffer
+            {
+                for (int i=0; i <n; i++)
+                {
+                    imagePointer[i]->removeBack();
+                }
+                records->removeBack();
+            }
+            if(spool){
+                slots->removeBack(); //its slot is overwritten once the ring wraps
+            }
+            if(history){
+                history->release(slots->removeBack()); //memory comes back a key group at a time
+            }
+            --frame; //go back a frame
+            Trace::instance().instant("remove back", "acquire", "frame", frame);
+            stringstream msg;
+            msg << "remove back "  << frame << " current size " <<imagePointer[0]->getSize();
+            genTL.memento(msg.str());
+        }
+        trig = false;
+        if(!monitor.quietLogging()){
+            cout<<"Grabbing frame "<<frame<<endl;
+        }
+
+        vector<unique_ptr<ScopedBuffer> > b(n); //requeued when the frame is done
+        vector<uint64_t> h(n); //host time at delivery of each buffer
+        vector<uint8_t *> cur(n);
+        vector<uint64_t> t(n);
+        uint64_t overhead = 0; //us spent on this buffer that does not grow with its part count, for the tuner
+        for (int i=0; i<n; i++)
+        {
+            TraceSpan wait("wait buffer", "acquire", "grabber", i, "frame", frame);
+            b[i].reset(new ScopedBuffer(*grabber[i])); // wait and get a buffer
+            h[i] = Tools::getTimestamp();
+            cur[i] = b[i]->getInfo<uint8_t *>(gc::BUFFER_INFO_BASE); //grab images for each grabber
+            t[i] = b[i]->getInfo<uint64_t>(gc::BUFFER_INFO_TIMESTAMP); //get each grabber's timestamp
+            partClocks[i].add(t[i]);
+            overhead += Tools::getTimestamp() - h[i];
+        }
+
+        const bool analyse = !monitor.pauseAnalysis(); //optional work is dropped while the queues fill up
+        TraceSpan analysis("motion energy", "acquire", "frame", frame);
+        for (int k=0; k<bufferSize; k++) //frame k of the buffer starts k*partBytes into it
+        {
+            motion[k] = 0;
+            for (int i=0; i<n; i++)
+            {
+                uint8_t *part = cur[i] + k*partBytes;
+                imagePointer[i]->insertFront(part);
+                if(analyse){
+                    motion[k] += energy.compute(part, prev[i]); //difference against the previous frame while it is still in the ring
+                }
+                prev[i] = part;
+            }
+        }
+        analysis.end();
+        if(spool){ //copy out now so the buffer can go back to the grabber
+            TraceSpan store("spool store", "acquire", "frame", frame);
+            spool->store(seq, &cur[0], n, bufBytes);
+            slots->insertFront(seq % spoolSlots);
+        }
+        if(history){ //compressed on the history workers, the buffer is held until it is no longer read
+            history->store(seq, &cur[0]);
+            slots->insertFront(seq);
+            held.push_back(std::move(b));
+        }
+        ++seq;
+
+        uint64_t fixedStart = Tools::getTimestamp();
+        int trigPart = -1; //frame of the buffer that gets the trigger flag
+        TraceSpan triggerCheck("trigger check", "acquire", "frame", frame);
+        if(grabber[m]->getInteger<InterfaceModule>("EventCount[LIN8]") > numTrig && (frame+1 >= halfList || historyFull) && stopCheck == false){ //trigger bools
+            stopCheck = true;
+            Trace::instance().instant("got trigger", "acquire", "frame", frame);
+            genTL.memento("got trigger");
+            try {
+                grabber[m]->processEvent<IoToolboxData>(10); //dispatch the LIN8 event to get its timestamp
+            }
+            catch (const std::exception &) {
+            }
+            if(grabber[m]->eventSeen){ //master and event share the interface clock
+                eventPending = true;
+                eventTime = grabber[m]->eventTime;
+            }
+            else{ //no timestamp, the newest frame stands for the event
+                trig = true;
+                trigPart = bufferSize - 1;
+            }
+        }
+        for (int k=0; eventPending && k<bufferSize; k++) //the event is usually later than the buffer it was noticed in
+        {
+            if(partClocks[m].partTime(k) >= eventTime){
+                trig = true;
+                trigPart = k; //first frame exposed after the event
+                clocks.triggerLatency = partClocks[m].partTime(k) - eventTime;
+                eventPending = false;
+            }
+        }
+        triggerCheck.end();
+        overhead += Tools::getTimestamp() - fixedStart;
+        TraceSpan insert("record", "acquire", "frame", frame);
+        uint64_t tmin = t[0];
+        uint64_t tmax = t[0];
+        for (int i=0; i<n; i++)
+        {
+            clocks.add(i, t[i], h[i]); //host time was taken at delivery of the whole buffer
+            tmin = min(tmin, t[i]);
+            tmax = max(tmax, t[i]);
+        }
+        clocks.skew.add(tmax - tmin);
+        StimulusFire fire;
+        while(scheduler && scheduler->takeFired(fire)){
+            fires.push_back(fire.hostTime);
+        }
+        for (int k=0; k<bufferSize; k++) //one record per frame, oldest first
+        {
+            uint64_t tsum = 0;
+            uint64_t hostSum = 0;
+            for (int i=0; i<n; i++)
+            {
+                const uint64_t partTs = partClocks[i].partTime(k);
+                tsum += partTs;
+                hostSum += clocks.toHost(i, partTs);
+            }
+            uint64_t tavg = tsum/n; //averave each grabber's timestamp
+            const bool trigFrame = trig && k == trigPart;
+            Record record = Record(frame*bufferSize + k, tavg, trigFrame, motion[k]);
+            record.hostTimeStamp = hostSum/n;
+            record.skew = tmax - tmin;
+            while(!fires.empty() && fires.front() <= record.hostTimeStamp){ //first frame after the fire, fires closer than a frame keep the earliest
+                if(record.stimulusTime == 0){
+                    record.stimulusTime = fires.front();
+                }
+                fires.pop_front();
+            }
+            records->insertFront(record); //insert image record to list
+            const bool firstFrame = seq == 1 && k == 0; //no previous frame, its energy of 0 would bias the baseline
+            if((analyse || trigFrame) && !firstFrame){
+                onset.add(motion[k], tavg, (seq-1)*bufferSize + k, trigFrame); //acquisition order, unlike frame it never goes back
+            }
+        }
+        insert.end();
+        fixedStart = Tools::getTimestamp();
+        if(monitor.sample(seq, grabber) && !monitor.quietLogging()){
+            cout<<monitor.live()<<endl;
+        }
+        b.clear(); //requeue the buffers before the next wait
+        if(history){
+            const unsigned int settled = history->getSettled();
+            while(!held.empty() && heldFirst < settled){
+                held.pop_front();
+                ++heldFirst;
+            }
+        }
+        overhead += Tools::getTimestamp() - fixedStart;
+        tuner.add(overhead);
+        if(monitor.aborted()){ //keep what was recorded, but stop grabbing
+            Trace::instance().instant("abort", "acquire", "frame", frame);
+            cout<<"Trial "<<trialCount<<" aborted: "<<monitor.getAbortReason()<<endl;
+            genTL.memento("abort: "+monitor.getAbortReason());
+            break;
+        }
+        if(history && history->getBytes() > historyBudget){ //post-trigger frames get the rest of the RAM
+            Trace::instance().instant("history full", "acquire", "frame", frame);
+            cout<<"Trial "<<trialCount<<" history memory full after frame "<<frame<<endl;
+            genTL.memento("history memory full");
+            break;
+        }
+    }
+    
+    stringstream msg;
+    msg << "finish recording, list size is " << imagePointer[0]->getSize();
+    genTL.memento(msg.str());
+    if(eventPending){
+        genTL.memento("trigger event after the last frame, no frame flagged");
+    }
+    if(scheduler){ //events past the end of the recording are not fired, the stimulus off runs now if it was cut
+        scheduler->stop();
+        cout<<"Trial "<<trialCount<<" "<<scheduler->report()<<endl;
+        genTL.memento(scheduler->report());
+        scheduler->save(trialDir(trialCount, camera)+"/stimulus_trial"+to_string(trialCount)+".csv");
+        scheduler.reset();
+    }
+    cout<<monitor.report()<<endl;
+    if(spool){
+        spool->flush();
+        stringstream msg;
+        msg << "spool flushed, " << spool->getStalls() << " stalls";
+        genTL.memento(msg.str());
+    }
+    if(history){
+        history->flush();
+        held.clear();
+        const double ratio = (double)history->getRawBytes()/max<uint64_t>(1, history->getCompressedBytes());
+        stringstream msg;
+        msg << "history " << history->getCodec() << " ratio " << ratio << ", " << history->getBytes()/1e6 << " MB, " << history->getStalls() << " stalls";
+        genTL.memento(msg.str());
+        cout<<"Trial "<<trialCount<<" "<<msg.str()<<endl;
+    }
+    for (int i=0; i<n; i++)
+    {
+        stringstream msg;
+        msg << "grabber " << camera.name << i << " drift " << (clocks.getFit(i).getDrift() - 1)*1e6 << " ppm, fit error " << clocks.getFit(i).getError() << " us";
+        genTL.memento(msg.str());
+    }
+    const string label = "Trial "+to_string(trialCount)+(camera.name.empty() ? "" : " "+camera.name);
+    cout<<label<<" grabber skew mean "<<clocks.skew.getMean()<<" us, sd "<<clocks.skew.getStdDev()<<" us, max "<<clocks.skew.getMax()<<" us"<<endl;
+    if(clocks.triggerLatency >= 0){
+        cout<<label<<" trigger to first frame latency "<<clocks.triggerLatency<<" us"<<endl;
+    }
+    else if(eventPending){
+        cout<<label<<" no frame grabbed after the trigger event"<<endl;
+    }
+    else{
+        cout<<label<<" trigger event time not available"<<endl;
+    }
+    const size_t recorded = imagePointer[0]->getSize()/bufferSize; //buffers, less than listSize when the trial was aborted
+    const int64_t firstRecorded = (int64_t)(seq - recorded)*bufferSize; //acquisition index of the oldest frame kept
+    const int64_t onsetFrame = onset.found() ? onset.onsetIndex - firstRecorded : -1; //position of the onset in the saved frames
+    if(onset.found()){ //reaction estimate straight from acquisition, before anything is saved
+        cout<<label<<" reaction onset at frame "<<onsetFrame<<", latency "<<onset.latency()<<" us"<<endl;
+    }
+    else{
+        cout<<label<<" no reaction onset detected"<<endl;
+    }
+    for (int i=0; i<n; i++)
+    {
+        grabber[i]->stop();
+    }
+    const std::string format (grabber[m]->getPixelFormat()); //save image formats
+    const size_t width = grabber[m]->getWidth();
+    const size_t height = grabber[m]->getHeight();
+    const size_t imgPitch = grabber[m]->getInteger<StreamModule>("LinePitch");
+    const size_t imgSize = height*imgPitch;
+    const size_t lineBytes = format == "Mono8" ? width : imgPitch; //bytes of each line in the frame CRC, the same as in the Y4M
+    const string dir = trialDir(trialCount, camera);
+    size_t exportFirst = 0; //saved frames are exportFirst..exportEnd-1 of the recorded ones
+    size_t exportEnd = recorded*bufferSize;
+    if(settings.exportBefore > 0 || settings.exportAfter > 0){
+        if(onsetFrame >= 0){ //only the frames around the reaction are encoded
+            exportFirst = (size_t)max<int64_t>(0, onsetFrame - settings.exportBefore);
+            exportEnd = (size_t)min<int64_t>(exportEnd, onsetFrame + settings.exportAfter + 1);
+        }
+        else{
+            cout<<label<<" no reaction onset, saving every frame"<<endl;
+        }
+        stringstream msg;
+        msg << "export frames " << exportFirst << " to " << exportEnd << " of " << recorded*bufferSize;
+        genTL.memento(msg.str());
+    }
+    unique_ptr<FrameSink> sink;
+    if(settings.output == OUTPUT_AVI){
+        sink.reset(new AviSink(*writer, dir+"/trial"+to_string(trialCount)+".avi", width, height*n, FPS, exportEnd - exportFirst));
+    }
+    else if(settings.output == OUTPUT_Y4M){
+        sink.reset(new Y4mSink(*writer, dir+"/trial"+to_string(trialCount)+".y4m", width, height*n, imgPitch, FPS, exportEnd - exportFirst));
+    }
+    else{
+        sink.reset(new JpegFileSink(*writer, dir+"/frame.NNN.jpeg"));
+    }
+    unique_ptr<JpegEncoder> encoder; //owns the destination memory for stitched images, finished before the sink goes
+    unique_ptr<uint8_t, void (*)(uint8_t *)> raw(NULL, alignedFree); //stitching destination when frames are saved without encoding
+    if(settings.output == OUTPUT_Y4M){
+        raw.reset(alignedAlloc(imgSize*n));
+    }
+    else{
+        encoder.reset(new JpegEncoder(genTL, *sink, format, width, height*n, imgPitch, settings.jpegQuality, settings.jpegSubsampling, settings.encoderThreads, settings.jpegGrayscale, settings.jpegFastDct));
+    }
+    unique_ptr<uint8_t, void (*)(uint8_t *)> spoolBuf(spool ? spool->allocSlot() : NULL, alignedFree); //frame read back from the spool
+    if(history){
+        history->beginDecode(seq - recorded, recorded); //the list holds the last recorded buffers
+    }
+    unique_ptr<Preview> preview; //low resolution stream built from the stitched lines, one frame per CSV row
+    if(settings.previewScale > 0 && format == "Mono8"){
+        preview.reset(new Preview(dir+"/preview_trial"+to_string(trialCount)+".y4m", width, height*n, settings.previewScale, FPS));
+    }
+    vector<uint8_t *> t(n);
+    for (size_t frames=0; frames<recorded; ++frames) { //begin saving
+        cout<<"Saving frame "<<frames<<" to disk "<<endl;
+        uint8_t *copy = NULL; //whole buffer of every grabber, when the grabber buffers have been reused
+        if(spool){ //the grabber buffers have been reused, take the copy from disk
+            TraceSpan read("spool read", "save", "frame", frames);
+            spool->read(slots->removeBack(), spoolBuf.get());
+            copy = spoolBuf.get();
+        }
+        int historySeq = -1;
+        if(history){ //decoded ahead on the history workers
+            TraceSpan read("history read", "save", "frame", frames);
+            historySeq = slots->removeBack();
+            copy = history->get(historySeq);
+        }
+        for (int  j=0; j <  bufferSize; j++) //do this for each buffer part
+        {
+            for (int i=0; i<n; i++)
+            {
+                t[i] = imagePointer[i]->removeBack(); //remove each frame from the back of the DLL
+                if(copy){
+                    t[i] = copy + i*bufBytes + j*imgSize;
+                }
+            }
+            const size_t position = frames * bufferSize +j;
+            if(position < exportFirst || position >= exportEnd){ //outside the export window, dropped without encoding
+                records->removeBack();
+                continue;
+            }
+            const size_t index = position - exportFirst; //frame of the video and row of the CSV
+            TraceSpan wait("wait encoder", "save", "frame", index);
+            uint8_t * des = encoder ? encoder->acquire() : raw.get(); //free stitching buffer, waits while all are being encoded
+            wait.end();
+            TraceSpan stitching("stitch", "save", "frame", index);
+            if(preview){
+                preview->beginFrame();
+            }
+            const uint32_t crc = stitch(des, t, camera, height, imgPitch, lineBytes, preview.get());
+            if(preview){
+                preview->endFrame();
+            }
+            stitching.end();
+
+            stringstream msg;
+            msg << "save image, remaining " << imagePointer[0]->getSize();
+            genTL.memento(msg.str());
+            Record rec = records->removeBack();
+            sink->setFrameTime(index, rec.timeStamp);
+            if(encoder){
+                encoder->submit(des, index); //encoded in parallel, written in frame order
+            }
+            else{
+                TraceSpan store("store", "write", "frame", index);
+                sink->put(index, des, imgSize*n, WriteDone()); //copied into the stream before returning
+            }
+            fileProcessor(*timer, rec, index, crc); //assign index and write image data
+        }
+        if(history){
+            history->recycle(historySeq);
+        }
+    }
+    if(encoder){
+        encoder->finish(); //wait for the last frames to land
+    }
+    else{
+        sink->finish();
+    }
+    sink->saveChecksums(dir+"/checksums_trial"+to_string(trialCount)+".csv"); //read by the verify tool
+    timer->finish(); //close file
+    encoder.reset();
+    sink.reset();
+    preview.reset();
+    spool.reset();
+    history.reset();
+    timer.reset();
+    writer.reset();
+    grabbers.clear();
+    genTL.memento("delete grabbers");
+}
+
+
+int main(){
+    //make it possible to change the before after ammount of images
+    int numTrials = 5;
+    TrialSettings settings;
+    settings.numBuf = 600;
+    settings.bufferSize = 1; //frames per buffer, more cuts the per-buffer work at high frame rates
+    settings.tuneParts = false; //choose the frames per buffer of each trial from the overhead measured in the previous one
+    settings.maxPartLatency = 10000; //a buffer holds at most 10 ms of frames
+    settings.concentration = 0.5;
+    settings.previewScale = 4; //downscale factor of the preview stream (4 or 8), 0 to disable
+    settings.jpegQuality = 90;
+    settings.jpegSubsampling = TJSAMP_420; //chroma subsampling of the RGB JPEGs
+    settings.jpegGrayscale = false;
+    settings.jpegFastDct = false;
+    settings.encoderThreads = 4;
+    settings.overrunPolicy = OVERRUN_QUIET_LOG | OVERRUN_PAUSE_ANALYSIS; //add OVERRUN_ABORT to stop a trial that loses frames
+    settings.monitorEvery = 50;
+    settings.trace = false; //timeline of each trial in trace_trialN.json (chrome://tracing or ui.perfetto.dev), about 8 MB per thread while on
+    settings.output = OUTPUT_AVI; //OUTPUT_JPEG_FILES for one frame.NNN.jpeg per frame, OUTPUT_Y4M for uncompressed Mono8
+    settings.scheduleStimulus = false; //fire the stimulus at the same time in every trial, see stimulus_trialN.csv for the measured lateness
+    settings.softwareStart = false;
+    settings.stimulusLine = "TTLIO12";
+    settings.cameraStartDelay = 100000;
+    settings.stimulusDelay = 500000; //after the pre-trigger part of the history has filled
+    settings.stimulusPulse = 1000;
+    settings.trialPeriod = 0;
+    settings.exportBefore = 0; //e.g. 200 and 800 to encode only 1000 frames around the reaction onset of each trial
+    settings.exportAfter = 0;
+    settings.spoolFrames = 0; //frames kept in the disk spool (D:/cameraOutput/spool.bin), 0 keeps the history in the grabber buffers only
+    settings.historyFrames = 0; //frames kept delta-compressed in RAM, several times numBuf for a mostly static scene; 0 to disable
+    settings.historyMB = 4096; //RAM of the compressed history, concentration of it before the trigger
+
+    if(settings.spoolFrames > 0 && settings.historyFrames > 0){
+        cerr<<"spoolFrames and historyFrames cannot both be set"<<endl;
+        return 1;
+    }
+    vector<CameraTopology> cameras; //one independent pipeline per camera
+    cameras.push_back(phantomS640("", 0));
+    //cameras.push_back(phantomS640("lateral", 2)); //second camera on boards 2 and 3, written to TrialN/lateral
+    for (size_t c=0; c<cameras.size(); c++)
+    {
+        checkTopology(cameras[c]);
+    }
+    EGenTL genTL; // load GenTL producer
+    Trace::instance().setEnabled(settings.trace);
+    vector<double> spoolRates(cameras.size(), 0); //bytes per second of the spool disk of each camera
+    if(settings.spoolFrames > 0){ //measured once, a sustained run takes seconds and would delay every trial
+        unique_ptr<FileWriter> writer(createFileWriter());
+        map<string, double> measured; //cameras may share a spool path
+        for (size_t c=0; c<cameras.size(); c++)
+        {
+            const string path = spoolPath(cameras[c]);
+            if(measured.count(path) == 0){
+                try {
+                    Spool bench(path, 8 << 20, 256, *writer); //2 GB ring
+                    measured[path] = bench.benchmark(8ULL << 30); //past the SLC and DRAM cache of the disk
+                }
+                catch (const std::exception &e) {
+                    cerr<<"spool benchmark on "<<path<<" failed: "<<e.what()<<endl;
+                    measured[path] = 0;
+                }
+                cout<<"Spool "<<path<<" sustains "<<measured[path]/1e6<<" MB/s"<<endl;
+            }
+            spoolRates[c] = measured[path];
+        }
+    }
+    vector<int> parts(cameras.size(), settings.bufferSize); //frames per buffer of each camera
+    vector<PartTuner> tuners(cameras.size(), PartTuner(FPS, max(1, (int)((int64_t)settings.maxPartLatency*FPS/1000000))));
+    const uint64_t firstTrial = Tools::getTimestampNs();
+    for(int trialCount = 1; trialCount <= numTrials; ++trialCount){ //run for certain ammount of trials
+        if(settings.trialPeriod > 0){ //trials start on a fixed grid, a long save only delays the next one
+            sleepUntilNs(firstTrial + (uint64_t)(trialCount - 1)*settings.trialPeriod*1000);
+        }
+        string temp = "D:/cameraOutput/Trial" + to_string(trialCount); //create directory for images and files
+        mkdir(temp.c_str());
+        vector<thread> pipelines;
+        for (size_t c=0; c<cameras.size(); c++)
+        {
+            mkdir(trialDir(trialCount, cameras[c]).c_str());
+            pipelines.push_back(thread([&genTL, &settings, &cameras, &parts, &tuners, &spoolRates, c, trialCount]{
+                try {
+                    sample(trialCount, genTL, cameras[c], settings, parts[c], tuners[c], spoolRates[c]);
+                }
+                catch (const std::exception &e) {
+                    cerr<<"Trial "<<trialCount<<" camera "<<cameras[c].name<<" failed: "<<e.what()<<endl;
+                }
+            }));
+        }
+        for (size_t c=0; c<pipelines.size(); c++)
+        {
+            pipelines[c].join();
+        }
+        for (size_t c=0; c<cameras.size(); c++)
+        {
+            const int chosen = tuners[c].choose(parts[c]);
+            cout<<"Camera "<<cameras[c].name<<" "<<tuners[c].report()<<endl;
+            if(settings.tuneParts){
+                parts[c] = chosen;
+            }
+        }
+        if(settings.trace){ //every pipeline thread has stopped, the buffers can be read
+            try {
+                Trace::instance().dump(temp+"/trace_trial"+to_string(trialCount)+".json");
+            }
+            catch (const std::exception &e) {
+                cerr<<e.what()<<endl;
+            }
+            Trace::instance().clear();
+        }
+    }
+    return 0;
+}